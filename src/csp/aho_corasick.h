@@ -0,0 +1,175 @@
+/*
+ * aho_corasick.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef AHO_CORASICK_H_
+#define AHO_CORASICK_H_
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace csp{
+
+// Finds any number of patterns in one pass over the text
+// The trie and its failure links are folded into a table with a move for
+//   every state and byte, so matching is one lookup per byte and never
+//   goes back
+// Bytes that aren't in any pattern all share one column of the table,
+//   which keeps it small enough to stay in cache
+class aho_corasick
+{
+	// Column of the table for each byte
+	// Column 0 is shared, so 256 bytes in patterns need 257 columns
+	uint16_t column[256];
+	size_t columns;
+	// Next state is moves[state * columns + column[byte]]
+	std::vector<uint32_t> moves;
+	// Pattern that ends at each state, -1 if none
+	std::vector<int32_t> ends;
+	// Closest state down the failure links where a pattern ends, -1 if none
+	std::vector<int32_t> shorter;
+	// True if any pattern ends at the state or down its failure links
+	std::vector<bool> accepts;
+	size_t patterns;
+
+	size_t add_state()
+	{
+		moves.resize(moves.size() + columns, 0);
+		ends.push_back(-1);
+		shorter.push_back(-1);
+		return ends.size() - 1;
+	}
+public:
+	// Duplicate patterns count once
+	aho_corasick(std::vector<std::string> list)
+	{
+		std::sort(list.begin(), list.end());
+		list.erase(std::unique(list.begin(), list.end()), list.end());
+		patterns = list.size();
+
+		// Column 0 is for bytes that no pattern has
+		memset(column, 0, sizeof(column));
+		columns = 1;
+		for (const std::string& p : list)
+			for (unsigned char c : p)
+				if (!column[c])
+					column[c] = columns++;
+
+		// Build the trie, 0 in moves means no child yet
+		// Nothing moves back to the root until the failure links go in
+		add_state();
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			size_t state = 0;
+			for (unsigned char c : list[i])
+			{
+				size_t at = state * columns + column[c];
+				if (!moves[at])
+				{
+					size_t next = add_state();
+					moves[at] = next;
+				}
+				state = moves[at];
+			}
+			ends[state] = i;
+		}
+
+		// Breadth first, so a state's failure link is done before its children
+		// A missing move takes the failure link's move instead
+		std::vector<uint32_t> fail (ends.size(), 0);
+		std::deque<uint32_t> queue;
+		for (size_t c = 0; c < columns; c++)
+			if (moves[c])
+				queue.push_back(moves[c]);
+		while (!queue.empty())
+		{
+			uint32_t state = queue.front();
+			queue.pop_front();
+			uint32_t f = fail[state];
+			shorter[state] = ends[f] != -1 ? f : shorter[f];
+			for (size_t c = 0; c < columns; c++)
+			{
+				uint32_t& next = moves[state * columns + c];
+				if (next)
+				{
+					fail[next] = moves[f * columns + c];
+					queue.push_back(next);
+				}
+				else
+					next = moves[f * columns + c];
+			}
+		}
+
+		accepts.resize(ends.size());
+		for (size_t i = 0; i < ends.size(); i++)
+			accepts[i] = ends[i] != -1 || shorter[i] != -1;
+	}
+
+	size_t size() const
+	{
+		return patterns;
+	}
+
+	// True if data has any of the patterns
+	bool any(const char* data, size_t size) const
+	{
+		if (accepts[0])
+			return true;
+		uint32_t state = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			state = moves[state * columns + column[(unsigned char)data[i]]];
+			if (accepts[state])
+				return true;
+		}
+		return false;
+	}
+
+	// True if data has every one of the patterns
+	bool all(const char* data, size_t size) const
+	{
+		if (!patterns)
+			return true;
+		// Which patterns were seen, only made once something matches
+		std::vector<uint64_t> seen;
+		size_t found = 0;
+
+		auto visit = [&](uint32_t state)
+		{
+			int32_t s = ends[state] != -1 ? state : shorter[state];
+			for (; s != -1; s = shorter[s])
+			{
+				if (seen.empty())
+					seen.resize((patterns + 63) / 64);
+				uint64_t flag = uint64_t(1) << (ends[s] & 63);
+				if (!(seen[ends[s] >> 6] & flag))
+				{
+					seen[ends[s] >> 6] |= flag;
+					found++;
+				}
+			}
+			return found == patterns;
+		};
+
+		if (accepts[0] && visit(0))
+			return true;
+		uint32_t state = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			state = moves[state * columns + column[(unsigned char)data[i]]];
+			if (accepts[state] && visit(state))
+				return true;
+		}
+		return false;
+	}
+};
+
+}
+
+#endif /* AHO_CORASICK_H_ */
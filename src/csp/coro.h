@@ -0,0 +1,279 @@
+/*
+ * coro.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef CORO_H_
+#define CORO_H_
+
+#if !defined(__cpp_impl_coroutine) || __cplusplus < 202002L
+#error "csp/coro.h needs C++20 coroutines, compile with -std=c++20"
+#endif
+
+#include <coroutine>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <tuple>
+
+#include <csp/pipe.h>
+
+namespace csp{
+
+// Threads that run coroutine channels, 0 for as many as the hardware has
+#ifndef CSP_CORO_THREADS
+#define CSP_CORO_THREADS 0
+#endif
+
+// Runs suspended coroutines once they are woken up
+// A coroutine waiting on read() or put() is only a few bytes on its stream,
+//   so thousands of channels can share a handful of threads
+class coro_scheduler
+{
+	std::mutex lock;
+	std::condition_variable work_ready;
+	// Coroutines to resume, or awaiters to look at their stream again
+	std::deque<std::function<void()>> ready;
+
+	coro_scheduler()
+	{
+		size_t threads = CSP_CORO_THREADS;
+		if (!threads)
+			threads = std::thread::hardware_concurrency();
+		if (!threads)
+			threads = 1;
+		for (size_t i = 0; i < threads; i++)
+			std::thread(&coro_scheduler::work, this).detach();
+	}
+
+	void work()
+	{
+		std::unique_lock<std::mutex> ul (lock);
+		while (true)
+		{
+			work_ready.wait(ul, [this]{ return !ready.empty(); });
+			std::function<void()> step = std::move(ready.front());
+			ready.pop_front();
+			ul.unlock();
+			step();
+			ul.lock();
+		}
+	}
+public:
+	// Never deleted, the threads can outlive static destructors
+	static coro_scheduler& get()
+	{
+		static coro_scheduler* result = new coro_scheduler();
+		return *result;
+	}
+
+	void schedule(std::coroutine_handle<> handle)
+	{
+		post([handle]{ handle.resume(); });
+	}
+	// Runs step on one of the threads
+	void post(std::function<void()> step)
+	{
+		std::lock_guard<std::mutex> lg (lock);
+		ready.push_back(std::move(step));
+		work_ready.notify_one();
+	}
+};
+
+// What a coroutine channel's run() returns
+// Starts suspended, coro_launch() hands it to the scheduler
+struct coro_task
+{
+	struct promise_type
+	{
+		// Called when run() returns
+		std::function<void()> finish;
+
+		coro_task get_return_object()
+		{
+			return coro_task{
+				std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void()
+		{
+			if (finish)
+				finish();
+		}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+// co_await read(x), suspends while the input is empty
+// Gives false when there is no input left, like channel::read()
+template<typename T>
+class read_awaiter : public event_waiter
+{
+	message_stream<T>* stream;
+	T& item;
+	bool result;
+	std::coroutine_handle<> handle;
+
+	// Reads an item or sees the end, like read_unlocked()
+	// Returns false if it went back to waiting instead
+	// A wake only means something happened, the item it was for might
+	//   have been read already or not be stored yet
+	bool poll()
+	{
+		while (true)
+		{
+			if (stream->try_read(item))
+				return result = true;
+			if (stream->finished)
+			{
+				// Anything written before finishing is visible now
+				result = stream->try_read(item);
+				return true;
+			}
+			if (stream->wait_write_async(this))
+				return false;
+		}
+	}
+public:
+	read_awaiter(message_stream<T>* stream, T& item) :
+		stream(stream), item(item), result(false) {}
+
+	bool await_ready()
+	{
+		if (stream->try_read(item))
+			return result = true;
+		return false;
+	}
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		handle = h;
+		return !poll();
+	}
+	bool await_resume()
+	{
+		return result;
+	}
+	void wake() override
+	{
+		// Looks again on a scheduler thread, the coroutine is still
+		//   suspended so only it reads the stream
+		coro_scheduler::get().post([this]{
+			if (poll())
+				handle.resume();
+		});
+	}
+};
+
+// co_await put(x), suspends while a bounded output is full
+template<typename T>
+class put_awaiter : public event_waiter
+{
+	message_stream<T>* stream;
+	T item;
+	std::coroutine_handle<> handle;
+
+	// Writes the item, returns false if it went back to waiting instead
+	// Like read_awaiter, a wake doesn't promise there is space
+	bool poll()
+	{
+		while (!stream->try_write(std::move(item)))
+			if (stream->wait_space_async(this))
+				return false;
+		return true;
+	}
+public:
+	put_awaiter(message_stream<T>* stream, T&& item) :
+		stream(stream), item(std::move(item)) {}
+
+	bool await_ready()
+	{
+		return stream->try_write(std::move(item));
+	}
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		handle = h;
+		return !poll();
+	}
+	void await_resume() {}
+	void wake() override
+	{
+		coro_scheduler::get().post([this]{
+			if (poll())
+				handle.resume();
+		});
+	}
+};
+
+// Base of channels made with CSP_CORO_DECL
+// read() and put() hide the blocking versions in channel
+// No members, since it gets cast from a plain channel like CSP_DECL
+template <typename t_in, typename t_out, typename... t_args>
+class coro_channel : public channel<t_in, t_out, t_args...>
+{
+public:
+	read_awaiter<t_in> read(t_in& input)
+	{
+		static_assert(!is_nothing<t_in>::value,
+				"Called read in csp pipe without input");
+		this->wait_input();
+		return read_awaiter<t_in>(this->csp_input, input);
+	}
+	put_awaiter<t_out> put(t_out out)
+	{
+		return put_awaiter<t_out>(this->csp_output, std::move(out));
+	}
+};
+
+// Starts a coroutine channel on the scheduler instead of a thread
+template <typename holder, typename t_in, typename t_out, typename... t_args>
+std::future<void> coro_launch(channel<t_in, t_out, t_args...>* chan)
+{
+	std::shared_ptr<std::promise<void>> done =
+			std::make_shared<std::promise<void>>();
+	std::future<void> result = done->get_future();
+
+	coro_task task = std::apply([chan](t_args&... a){
+		return ((holder*)chan)->run(a...);
+	}, chan->arguments);
+	task.handle.promise().finish = [chan, done]{
+		chan->finish();
+		done->set_value();
+	};
+	coro_scheduler::get().schedule(task.handle);
+	return result;
+}
+
+template <typename t_in, typename t_out, typename holder, typename... t_args>
+csp::shared_ptr<channel<t_in, t_out, t_args...>> coro_create(t_args... args)
+{
+	using this_pipe = channel<t_in, t_out, t_args...>;
+	csp::shared_ptr<this_pipe> a = csp::make_shared<this_pipe>();
+	a->arguments = std::make_tuple(args...);
+	a->launcher = &coro_launch<holder, t_in, t_out, t_args...>;
+	return a;
+}
+
+}
+
+// Like CSP_DECL, but the body is a coroutine
+// Use co_await read(x) and co_await put(x), they suspend instead of
+//   blocking a thread, and co_return at the end
+#define CSP_CORO_DECL(fn_name, input, output, ...)\
+	class _##fn_name##_t_ : public csp::coro_channel<input,output,##__VA_ARGS__>\
+	{\
+	public:\
+		csp::coro_task run(__VA_ARGS__);\
+	};\
+	csp::shared_ptr<csp::channel<input,output,##__VA_ARGS__>> (*fn_name)(__VA_ARGS__) =\
+		csp::coro_create<input,output,_##fn_name##_t_,##__VA_ARGS__>;\
+	csp::coro_task _##fn_name##_t_ ::run
+
+#endif /* CORO_H_ */
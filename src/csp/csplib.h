@@ -11,10 +11,22 @@
 #include <iostream>
 #include <fstream>
 #include <atomic>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 
 #include <csp/pipe.h>
 #include <csp/read.h>
 #include <csp/string.h>
+#include <csp/hash_set.h>
+#include <csp/aho_corasick.h>
+#include <csp/regex.h>
+#include <csp/line_view.h>
+#include <csp/line_reader.h>
+#include <csp/uring.h>
 
 namespace csp{
 /* ================================
@@ -30,12 +42,7 @@ namespace csp{
 CSP_DECL(cat, csp::nothing, csp::string, const char*, std::atomic<int>*)
 												(const char* file, std::atomic<int>* error)
 {
-	FILE* fp;
-	char* line = NULL;
-	size_t len = 0;
-	ssize_t read_amt;
-
-	fp = fopen(file, "r");
+	int fd = open(file, O_RDONLY);
 
 	// Check for errors
 	// The CSP library does not implement fancy error propagation techniques
@@ -44,43 +51,207 @@ CSP_DECL(cat, csp::nothing, csp::string, const char*, std::atomic<int>*)
 	//   like the Unix counterpart.
 	// It would be unwise to use pass exceptions beyond the CSP function because
 	//   the listening channels would not be able to catch and clean up properly
-	if (fp == NULL)
+	if (fd < 0)
 	{
 		*error = 1;
 		return;
 	}
 
-	while ((read_amt = getline(&line, &len, fp)) != -1)
+	// Lines come out of big blocks, not a getline() each
+	if (!read_lines_to(fd, this->csp_output))
+		*error = 1;
+	close(fd);
+} // cat
+
+/* ================================
+ * mmap_cat
+ * Like cat, but maps the file and writes out views into it
+ * No line is copied or allocated, the mapping stays until the channel
+ *   is gone, so keep the pipeline around while using the views
+ * grab, grab_any, grab_all, grep_re and chan_select all take
+ *   line_view, call them as grab<line_view>(...)
+ * Sets error to 1 if the file can't be opened or mapped
+ * ================================
+ */
+CSP_DECL(mmap_cat, csp::nothing, csp::line_view, const char*, std::atomic<int>*)
+												(const char* file, std::atomic<int>* error)
+{
+	std::shared_ptr<const mapped_file> mapped = mapped_file::open(file);
+	if (!mapped)
 	{
-		if (line[read_amt - 1] == '\n')
-			read_amt--;
+		*error = 1;
+		return;
+	}
+	this->keep_alive = mapped;
 
-		string output;
-		output.setdata(line, read_amt, len);
-		this->put(std::move(output));
+	// A source has no input stream to take batch_size() from
+	std::vector<line_view> lines (CSP_CHUNK_MAX / 8);
+	size_t count = 0;
+	const char* at = mapped->data();
+	const char* end = at + mapped->size();
+	while (at < end)
+	{
+		const char* newline = (const char*)memchr(at, '\n', end - at);
+		const char* stop = newline ? newline : end;
+		lines[count++] = line_view(at, stop - at);
+		if (count == lines.size())
+		{
+			this->put_batch(lines.data(), count);
+			count = 0;
+		}
+		at = stop + 1;
+	}
+	this->put_batch(lines.data(), count);
+} // mmap_cat
 
-		line = NULL;
-		len = 0;
+/* ================================
+ * uring_cat
+ * Like cat, but keeps CSP_URING_DEPTH reads of a block each in flight
+ *   through io_uring, so a fast disk never sits on one read at a time
+ * Reads finish in any order, lines still come out in file order
+ * Reads the way cat does if there is no io_uring or the file isn't a
+ *   regular file
+ * Sets error to 1 if the file can't be opened or a read fails
+ * ================================
+ */
+CSP_DECL(uring_cat, csp::nothing, csp::string, const char*, std::atomic<int>*)
+												(const char* file, std::atomic<int>* error)
+{
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+	{
+		*error = 1;
+		return;
+	}
+	struct stat st;
+	std::unique_ptr<uring> ring;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode))
+		ring = uring::open(CSP_URING_DEPTH);
+	if (!ring)
+	{
+		if (!read_lines_to(fd, this->csp_output))
+			*error = 1;
+		close(fd);
+		return;
 	}
 
-	fclose(fp);
-	if (line)
-		free(line);
-} // cat
+	// Slots take blocks of the file in turn, so the slot after the last
+	//   one handed out always holds the next block
+	struct read_slot
+	{
+		char* block;
+		uint64_t offset;
+		size_t filled;
+		bool done;
+	};
+	read_slot slots[CSP_URING_DEPTH];
+	size_t taken = 0;
+	while (taken < CSP_URING_DEPTH &&
+			(slots[taken].block = block_pool::get().take()))
+		taken++;
+	if (taken < CSP_URING_DEPTH)
+	{
+		// Out of memory
+		for (size_t i = 0; i < taken; i++)
+			block_pool::get().give(slots[i].block);
+		*error = 1;
+		close(fd);
+		return;
+	}
+	uint64_t offset = 0;
+	for (size_t i = 0; i < CSP_URING_DEPTH; i++)
+	{
+		slots[i].offset = offset;
+		slots[i].filled = 0;
+		slots[i].done = false;
+		ring->read(fd, slots[i].block, CSP_READ_BLOCK, offset, i);
+		offset += CSP_READ_BLOCK;
+	}
+	size_t in_flight = CSP_URING_DEPTH;
+	size_t front = 0;
+	bool eof = false;
+	bool failed = false;
+	line_batch batch (this->csp_output);
+
+	while (in_flight)
+	{
+		uint64_t tag;
+		int result;
+		if (!ring->wait(tag, result))
+		{
+			// Reads may still land in the blocks, so they can't be reused
+			*error = 1;
+			close(fd);
+			return;
+		}
+		in_flight--;
+		read_slot& slot = slots[tag];
+		if (result < 0)
+			failed = true;
+		else
+			slot.filled += result;
+		// A short read that isn't the end of the file reads the rest
+		if (result > 0 && slot.filled < CSP_READ_BLOCK &&
+				slot.offset + slot.filled < (uint64_t)st.st_size && !failed)
+		{
+			ring->read(fd, slot.block + slot.filled,
+					CSP_READ_BLOCK - slot.filled, slot.offset + slot.filled, tag);
+			in_flight++;
+			continue;
+		}
+		slot.done = true;
+
+		while (!failed && slots[front].done)
+		{
+			read_slot& next = slots[front];
+			batch.feed(next.block, next.filled);
+			next.done = false;
+			if (next.filled < CSP_READ_BLOCK)
+				eof = true;
+			if (!eof)
+			{
+				next.offset = offset;
+				next.filled = 0;
+				ring->read(fd, next.block, CSP_READ_BLOCK, offset, front);
+				offset += CSP_READ_BLOCK;
+				in_flight++;
+			}
+			front = (front + 1) % CSP_URING_DEPTH;
+		}
+	}
+	batch.finish();
+
+	for (read_slot& slot : slots)
+		block_pool::get().give(slot.block);
+	close(fd);
+	if (failed)
+		*error = 1;
+} // uring_cat
 
 /* ================================
  * to_lower
  * Outputs input, but in lower case
+ * Only ASCII letters are lowered unless utf8 is set
  * ================================
  */
-CSP_DECL(to_lower, csp::string, csp::string) ()
+struct to_lower_fn
 {
-	csp::string line;
-	while (read(line))
+	bool utf8;
+
+	bool operator()(csp::string& line, csp::string& out) const
 	{
-		std::transform(line.begin(), line.end(), line.begin(), ::tolower);
-		put(std::move(line));
+		if (utf8)
+			lower_utf8(line.data(), line.size());
+		else
+			lower_ascii(line.data(), line.size());
+		out = std::move(line);
+		return true;
 	}
+};
+inline csp::shared_ptr<csp::channel<csp::string, csp::string,
+		each_fn<csp::string, csp::string, to_lower_fn>>> to_lower(bool utf8 = false)
+{
+	return chan_each<csp::string, csp::string>(to_lower_fn{utf8});
 }// to_lower
 
 /* ================================
@@ -88,62 +259,537 @@ CSP_DECL(to_lower, csp::string, csp::string) ()
  * Sorts stuff
  * Call with sort<yourType>()
  * This is how you have to do templates with pipes
- * Sorting with heap allows us to sort while receiving input AND output
- * This optimizes the flow of the pipeline, more operations can happen at once
- *   push_heap is very fast -- average constant time
- *     Allows for O(log n) sorting time after input has finished
- *       (Output is also streamed while sorting)
+ * Input is cut into runs of CSP_SORT_RUN items, each run gets sorted
+ *   on another thread while the rest of the input is still coming in
+ * Once input is done the runs are merged together straight to output
+ * csp::strings are sorted with a radix sort instead of comparisons
+ * Give a memory budget in bytes to sort more than fits in memory,
+ *   every time the runs go over it they're merged into a temporary
+ *   file in $TMPDIR, and the files get merged at the end
+ * Every CSP_SPILL_FILES files are merged into one along the way, so
+ *   only that many are ever open
+ * Only types that are spillable can go to disk, others ignore the budget
+ * Sets error to 1 if a temporary file can't be made, written or read
+ *   back. If it can't be made the sort carries on in memory, if it
+ *   can't be written or read back lines are missing from the output
  * ================================
  */
+// Items in each run sorted on its own
+#define CSP_SORT_RUN 65536
+// Buffer for each temporary file, the merge reads them all at once
+#define CSP_SPILL_BUFFER (1 << 20)
+// Most temporary files kept before they're merged into one
+#define CSP_SPILL_FILES 64
+// Characters the radix sort goes into strings before it compares the
+//   rest, each one is a stack frame of a few KB
+#define CSP_RADIX_DEPTH 64
+
+// Types sort() can write to temporary files with spill_write()
+// Plain types are written as they are, specialize this and overload
+//   spill_write() and spill_read() for types that own memory
+// Both return false if the file couldn't be written or read
+template <typename T>
+struct spillable : std::is_trivially_copyable<T> {};
+template <>
+struct spillable<csp::string> : std::true_type {};
+
+template <typename T>
+bool spill_write(FILE* file, const T& item)
+{
+	return fwrite(&item, sizeof(T), 1, file) == 1;
+}
+template <typename T>
+bool spill_read(FILE* file, T& item)
+{
+	return fread(&item, sizeof(T), 1, file) == 1;
+}
+inline bool spill_write(FILE* file, const csp::string& item)
+{
+	size_t size = item.size();
+	return fwrite(&size, sizeof(size), 1, file) == 1 &&
+			fwrite(item.data(), 1, size, file) == size;
+}
+inline bool spill_read(FILE* file, csp::string& item)
+{
+	size_t size;
+	if (fread(&size, sizeof(size), 1, file) != 1)
+		return false;
+	item.resize(size);
+	return fread(item.data(), 1, size, file) == size;
+}
+
+// A sorted run, read front to back while merging
 template <typename t_in>
-class sort_t_: public csp::channel<t_in, t_in, bool>
+struct sorted_run
 {
+	virtual ~sorted_run() {}
+	virtual bool empty() = 0;
+	virtual t_in& front() = 0;
+	virtual void pop() = 0;
+};
+
+// A sorted run kept in memory
+template <typename t_in>
+struct memory_run : sorted_run<t_in>
+{
+	std::vector<t_in> items;
+	size_t position;
+
+	memory_run(std::vector<t_in>&& items) :
+		items(std::move(items)), position(0) {}
+
+	bool empty() override { return position >= items.size(); }
+	t_in& front() override { return items[position]; }
+	void pop() override
+	{
+		// Let go of the memory as soon as the run is used up
+		if (++position == items.size())
+			std::vector<t_in>().swap(items);
+	}
+};
+
+// A sorted run in a temporary file
+// The file is deleted right away, it's gone once closed
+template <typename t_in>
+class spill_run : public sorted_run<t_in>
+{
+	FILE* file;
+	std::vector<char> buffer;
+	t_in current;
+	bool has_current;
+	bool bad;
 public:
-	void run(bool reverse)
+	spill_run() : file(NULL), has_current(false), bad(false)
 	{
-		std::vector<t_in> output;
-		auto functor = reverse? [](t_in& a, t_in&b){ return a < b; }
-					: [](t_in& a, t_in& b){ return a > b; };
+		const char* dir = getenv("TMPDIR");
+		std::string path = std::string(dir? dir : "/tmp") + "/csp_sort_XXXXXX";
+		int fd = mkstemp(&path[0]);
+		if (fd == -1)
+			return;
+		unlink(path.c_str());
+		file = fdopen(fd, "w+");
+		if (!file)
+		{
+			close(fd);
+			return;
+		}
+		buffer.resize(CSP_SPILL_BUFFER);
+		setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+	}
+	~spill_run()
+	{
+		if (file)
+			fclose(file);
+	}
+	// False if the file couldn't be made
+	bool ok() { return file != NULL; }
+	// True once a write or read has gone wrong
+	// A file that failed while being written can't be read back
+	bool failed() { return bad || ferror(file); }
 
-		std::make_heap(output.begin(), output.end(), functor);
-		t_in line;
+	void write(const t_in& item)
+	{
+		// The first failure is enough, the disk is likely full
+		if (!bad && !spill_write(file, item))
+			bad = true;
+	}
+	// Call after the last write to start reading
+	void finish()
+	{
+		if (fflush(file) || ferror(file))
+			bad = true;
+		rewind(file);
+		if (!bad)
+			pop();
+	}
 
-		while (this->read(line))
+	bool empty() override { return !has_current; }
+	t_in& front() override { return current; }
+	void pop() override { has_current = spill_read(file, current); }
+};
+
+// Merges sorted runs, calling out with every item in order
+template <typename t_in, typename F>
+void merge_runs(const std::vector<sorted_run<t_in>*>& runs, bool reverse, F out)
+{
+	// The heap has every run with items left,
+	//   with the run whose next item goes first on top
+	std::vector<sorted_run<t_in>*> heap;
+	for (auto a : runs)
+		if (!a->empty())
+			heap.push_back(a);
+	auto later = [reverse](sorted_run<t_in>* a, sorted_run<t_in>* b)
+	{
+		return reverse? a->front() < b->front() : b->front() < a->front();
+	};
+	std::make_heap(heap.begin(), heap.end(), later);
+
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), later);
+		sorted_run<t_in>* a = heap.back();
+		out(std::move(a->front()));
+		a->pop();
+		if (a->empty())
+			heap.pop_back();
+		else
+			std::push_heap(heap.begin(), heap.end(), later);
+	}
+}
+
+// Sorts a run in place, largest first if reverse
+template <typename t_in>
+void sort_run(std::vector<t_in>& run, bool reverse)
+{
+	if (reverse)
+		std::sort(run.begin(), run.end(),
+				[](const t_in& a, const t_in& b){ return b < a; });
+	else
+		std::sort(run.begin(), run.end());
+}
+
+// Which bucket a string goes in by its character at depth
+// Strings that end before depth go first in bucket 0
+inline int string_bucket(const csp::string* str, size_t depth)
+{
+	if (depth >= str->size())
+		return 0;
+	return (unsigned char)(*str)[depth] + 1;
+}
+// a < b for strings that match up to depth
+inline bool string_less(const csp::string* a, const csp::string* b, size_t depth)
+{
+	size_t common = std::min(a->size(), b->size()) - depth;
+	int result = memcmp(a->data() + depth, b->data() + depth, common);
+	return result < 0 || (result == 0 && a->size() < b->size());
+}
+// MSD radix sort of strings that all match up to depth
+// aux is scratch space as big as a
+inline void string_radix(csp::string** a, csp::string** aux, size_t n,
+		size_t depth)
+{
+	// Small buckets aren't worth counting
+	if (n < 32)
+	{
+		for (size_t i = 1; i < n; i++)
+			for (size_t j = i; j > 0 && string_less(a[j], a[j - 1], depth); j--)
+				std::swap(a[j], a[j - 1]);
+		return;
+	}
+	// Strings that share a long prefix would recurse once per character
+	//   of it, so past a point they're compared instead
+	if (depth >= CSP_RADIX_DEPTH)
+	{
+		std::sort(a, a + n, [depth](const csp::string* x, const csp::string* y){
+			return string_less(x, y, depth);
+		});
+		return;
+	}
+
+	size_t start[258] = {0};
+	for (size_t i = 0; i < n; i++)
+		start[string_bucket(a[i], depth) + 1]++;
+	for (int b = 1; b < 258; b++)
+		start[b] += start[b - 1];
+
+	size_t next[257];
+	std::copy(start, start + 257, next);
+	for (size_t i = 0; i < n; i++)
+		aux[next[string_bucket(a[i], depth)]++] = a[i];
+	std::copy(aux, aux + n, a);
+
+	// Bucket 0 is all strings that ended, they're equal
+	for (int b = 1; b < 257; b++)
+		if (start[b + 1] - start[b] > 1)
+			string_radix(a + start[b], aux, start[b + 1] - start[b], depth + 1);
+}
+inline void sort_run(std::vector<csp::string>& run, bool reverse)
+{
+	std::vector<csp::string*> order (run.size());
+	std::vector<csp::string*> aux (run.size());
+	for (size_t i = 0; i < run.size(); i++)
+		order[i] = &run[i];
+	string_radix(order.data(), aux.data(), order.size(), 0);
+
+	std::vector<csp::string> sorted;
+	sorted.reserve(run.size());
+	for (auto a : order)
+		sorted.push_back(std::move(*a));
+	if (reverse)
+		std::reverse(sorted.begin(), sorted.end());
+	run.swap(sorted);
+}
+
+template <typename t_in>
+class sort_t_: public csp::channel<t_in, t_in, bool, size_t, std::atomic<int>*>
+{
+public:
+	void run(bool reverse, size_t budget, std::atomic<int>* error)
+	{
+		if (!spillable<t_in>::value)
+			budget = 0;
+		auto fail = [error]
 		{
-			output.push_back(std::move(line));
-			std::push_heap(output.begin(), output.end(), functor);
-		}
+			if (error)
+				*error = 1;
+		};
 
-		int siz = output.size();
-		for (int i = 0; i < siz; i++)
+		// deque so runs don't move while they're being sorted
+		std::deque<std::vector<t_in>> runs;
+		std::vector<std::future<void>> sorting;
+		auto sort_last = [&]
+		{
+			std::vector<t_in>* last = &runs.back();
+			sorting.push_back(executor::get().run([last, reverse]{
+				sort_run(*last, reverse);
+			}));
+		};
+		// Waits for the runs to be sorted and gets them ready to merge
+		std::vector<std::unique_ptr<memory_run<t_in>>> sorted;
+		auto finish_runs = [&]
 		{
-			this->put(std::move(output.front()));
-			std::pop_heap(output.begin(), output.end() - i, functor);
+			if (!runs.back().empty())
+				sort_last();
+			for (auto& a : sorting)
+				a.wait();
+			sorting.clear();
+			for (auto& a : runs)
+				if (!a.empty())
+					sorted.emplace_back(new memory_run<t_in>(std::move(a)));
+			runs.clear();
+			runs.emplace_back();
+		};
+
+		// Merges runs into a new file
+		// Returns false if there was nowhere to put the file
+		// A file that couldn't be written is dropped, it can't be trusted
+		std::vector<std::unique_ptr<spill_run<t_in>>> spills;
+		auto merge_to_file = [&](const std::vector<sorted_run<t_in>*>& merging)
+		{
+			std::unique_ptr<spill_run<t_in>> file (new spill_run<t_in>());
+			if (!file->ok())
+				return false;
+			spill_run<t_in>* to = file.get();
+			merge_runs(merging, reverse, [to](t_in&& item){ to->write(item); });
+			file->finish();
+			if (file->failed())
+				fail();
+			else
+				spills.push_back(std::move(file));
+			return true;
+		};
+		// Merges everything in memory into a file
+		// Once there are CSP_SPILL_FILES files they're merged into one,
+		//   so open files and their buffers stay bounded
+		// Returns false if there was nowhere to put a file or writing failed
+		auto spill = [&]
+		{
+			if (spills.size() >= CSP_SPILL_FILES)
+			{
+				std::vector<std::unique_ptr<spill_run<t_in>>> old;
+				old.swap(spills);
+				std::vector<sorted_run<t_in>*> merging;
+				for (auto& a : old)
+					merging.push_back(a.get());
+				bool made = merge_to_file(merging);
+				for (auto& a : old)
+					if (a->failed())
+						fail();
+				if (!made)
+				{
+					old.swap(spills);
+					return false;
+				}
+				if (spills.empty())
+					return false;
+			}
+
+			finish_runs();
+			std::vector<sorted_run<t_in>*> merging;
+			for (auto& a : sorted)
+				merging.push_back(a.get());
+			size_t files = spills.size();
+			if (!merge_to_file(merging))
+				return false;
+			sorted.clear();
+			return spills.size() > files;
+		};
+
+		std::vector<t_in> items (this->batch_size());
+		size_t count;
+		size_t bytes = 0;
+		runs.emplace_back();
+		while ((count = this->read_batch(items.data(), items.size())))
+		{
+			std::vector<t_in>& run = runs.back();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (budget)
+					bytes += stream_item_size(items[i]);
+				run.push_back(std::move(items[i]));
+			}
+			if (run.size() >= CSP_SORT_RUN)
+			{
+				sort_last();
+				runs.emplace_back();
+			}
+
+			if (budget && bytes > budget)
+			{
+				// Keep going in memory if there's nowhere to spill to
+				if (!spill())
+				{
+					fail();
+					budget = 0;
+				}
+				bytes = 0;
+			}
 		}
+		// Whatever is left in memory gets merged along with the files
+		finish_runs();
+
+		size_t kept = 0;
+		auto out = [&](t_in&& item)
+		{
+			items[kept++] = std::move(item);
+			if (kept == items.size())
+			{
+				this->put_batch(items.data(), kept);
+				kept = 0;
+			}
+		};
+		std::vector<sorted_run<t_in>*> merging;
+		for (auto& a : sorted)
+			merging.push_back(a.get());
+		for (auto& a : spills)
+			merging.push_back(a.get());
+		merge_runs(merging, reverse, out);
+		this->put_batch(items.data(), kept);
+		for (auto& a : spills)
+			if (a->failed())
+				fail();
 	}
 };
 template <typename t_in>
-csp::shared_ptr<csp::channel<t_in, t_in, bool>> sort(bool a = false)
+csp::shared_ptr<csp::channel<t_in, t_in, bool, size_t, std::atomic<int>*>>
+	sort(bool a = false, size_t budget = 0, std::atomic<int>* error = NULL)
 {
-	return csp::chan_create<
-			t_in, t_in, sort_t_<t_in>, bool>(a);
+	return csp::chan_create<t_in, t_in, sort_t_<t_in>,
+			bool, size_t, std::atomic<int>*>(a, budget, error);
 }/* sort */
 
 /* ================================
  * grab
  * Writes out strings that contain the specified string
+ * ignore_case matches ASCII letters of either case
+ * Works on csp::string or, with grab<line_view>, on lines from mmap_cat
  * ================================
  */
-CSP_DECL(grab, csp::string, csp::string, const char*, bool)
-								(const char* search, bool invert)
-{
-	csp::string current_line;
-	while (read(current_line))
-		// Put string if the currently line contains search
-		if ((current_line.find(search) == csp::string::npos) == invert)
-			put(std::move(current_line));
+struct grab_fn
+{
+	// Lowered already if ignore_case is set
+	std::string search;
+	bool invert;
+	bool ignore_case;
+
+	template <typename T>
+	bool operator()(T& line, T& out) const
+	{
+		// An empty line may have no data to point into
+		bool found = search.empty() || (ignore_case ?
+				find_nocase(line.data(), line.size(), search.data(), search.size()) :
+				find_bytes(line.data(), line.size(), search.data(), search.size()));
+		if (found == invert)
+			return false;
+		out = std::move(line);
+		return true;
+	}
+};
+template <typename T = csp::string>
+csp::shared_ptr<csp::channel<T, T, each_fn<T, T, grab_fn>>>
+	grab(const char* search, bool invert, bool ignore_case = false)
+{
+	std::string a (search);
+	if (ignore_case)
+		lower_ascii(&a[0], a.size());
+	return chan_each<T, T>(grab_fn{a, invert, ignore_case});
 } // grab
 
+/* ================================
+ * grab_any, grab_all
+ * Like a chain of grabs, but every pattern is looked for in one pass
+ *   over the line, however many patterns there are
+ * grab_any writes out lines with at least one of the patterns,
+ *   grab_all lines with every one of them
+ * invert writes out the lines that would have been left out
+ * ================================
+ */
+struct grab_set_fn
+{
+	std::shared_ptr<const aho_corasick> patterns;
+	bool all;
+	bool invert;
+
+	template <typename T>
+	bool operator()(T& line, T& out) const
+	{
+		bool found = all ? patterns->all(line.data(), line.size())
+				: patterns->any(line.data(), line.size());
+		if (found == invert)
+			return false;
+		out = std::move(line);
+		return true;
+	}
+};
+template <typename T = csp::string>
+csp::shared_ptr<csp::channel<T, T, each_fn<T, T, grab_set_fn>>>
+	grab_any(std::vector<std::string> patterns, bool invert = false)
+{
+	return chan_each<T, T>(grab_set_fn{
+		std::make_shared<aho_corasick>(std::move(patterns)), false, invert});
+}
+template <typename T = csp::string>
+csp::shared_ptr<csp::channel<T, T, each_fn<T, T, grab_set_fn>>>
+	grab_all(std::vector<std::string> patterns, bool invert = false)
+{
+	return chan_each<T, T>(grab_set_fn{
+		std::make_shared<aho_corasick>(std::move(patterns)), true, invert});
+} // grab_any, grab_all
+
+/* ================================
+ * grep_re
+ * Writes out strings with a match for an extended regular expression,
+ *   like grep -E, without leaving the process
+ * Sets error to 1 if the pattern doesn't compile, nothing gets written then
+ * ================================
+ */
+struct grep_re_fn
+{
+	// Every thread running this gets a copy, with a DFA of its own
+	mutable regex_matcher matcher;
+	bool invert;
+
+	template <typename T>
+	bool operator()(T& line, T& out) const
+	{
+		if (!matcher.ok() ||
+				matcher.search(line.data(), line.size()) == invert)
+			return false;
+		out = std::move(line);
+		return true;
+	}
+};
+template <typename T = csp::string>
+csp::shared_ptr<csp::channel<T, T, each_fn<T, T, grep_re_fn>>>
+	grep_re(const char* pattern, bool invert = false,
+			std::atomic<int>* error = NULL)
+{
+	auto re = std::make_shared<regex>(pattern);
+	if (!re->ok && error)
+		*error = 1;
+	return chan_each<T, T>(grep_re_fn{regex_matcher(re), invert});
+} // grep_re
+
 /* ================================
  * Generic uniq
  * Works well with sort
@@ -155,21 +801,29 @@ template <typename t_in> class uniq_t : public csp::channel<t_in,t_in>
 public:
 	void run()
 	{
-		t_in current, last;
-		bool shouldecho = false;
-		while(this->read(current))
+		std::vector<t_in> items (this->batch_size());
+		t_in last;
+		bool first = true;
+		size_t count;
+		while ((count = this->read_batch(items.data(), items.size())))
 		{
-			if (current != last)
+			// Compare against the last item kept, or the previous batch's
+			size_t kept = 0;
+			for (size_t i = 0; i < count; i++)
 			{
-				shouldecho = true;
-				this->put(std::move(last));
-				last = std::move(current);
+				const t_in& previous = kept? items[kept - 1] : last;
+				if (first || items[i] != previous)
+				{
+					first = false;
+					if (kept != i)
+						items[kept] = std::move(items[i]);
+					kept++;
+				}
 			}
-			else
-				shouldecho = false;
+			if (kept)
+				last = items[kept - 1];
+			this->put_batch(items.data(), kept);
 		}
-		if (shouldecho)
-			this->put(std::move(last));
 	}
 };
 template <typename t_in> csp::shared_ptr<csp::channel<t_in, t_in>> uniq()
@@ -178,25 +832,257 @@ template <typename t_in> csp::shared_ptr<csp::channel<t_in, t_in>> uniq()
 			t_in, t_in, uniq_t<t_in>>();
 }/* uniq */
 
+/* ================================
+ * distinct
+ * Removes every repeated item, not just adjacent ones like uniq
+ * Items come out as soon as they're first seen, input doesn't
+ *   have to be sorted
+ * Give a memory budget in bytes to cap the memory used,
+ *   once the set of seen items goes over it they're traded for a bloom
+ *   filter of about that size, after which a new item is sometimes taken for a
+ *   repeat and dropped
+ * ================================
+ */
+template <typename t_in> class distinct_t : public csp::channel<t_in,t_in,size_t>
+{
+public:
+	void run(size_t budget)
+	{
+		hash_set<t_in> seen;
+		std::unique_ptr<bloom_filter> approximate;
+
+		std::vector<t_in> items (this->batch_size());
+		size_t count;
+		while ((count = this->read_batch(items.data(), items.size())))
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				uint64_t hash = item_hash(items[i]);
+				bool first = approximate?
+						!approximate->insert(hash) : seen.insert(items[i], hash);
+				if (first)
+				{
+					if (kept != i)
+						items[kept] = std::move(items[i]);
+					kept++;
+				}
+			}
+			this->put_batch(items.data(), kept);
+
+			if (budget && !approximate && seen.bytes() > budget)
+			{
+				// The set goes first and the filter gets the budget less
+				//   the hashes it's filled from, so both never add up to more
+				std::vector<uint64_t> hashes = seen.take_hashes();
+				size_t hash_bytes = hashes.size() * sizeof(uint64_t);
+				approximate.reset(new bloom_filter(budget > hash_bytes * 2 ?
+						budget - hash_bytes : budget / 2));
+				for (uint64_t hash : hashes)
+					approximate->insert(hash);
+			}
+		}
+	}
+};
+template <typename t_in>
+csp::shared_ptr<csp::channel<t_in, t_in, size_t>> distinct(size_t budget = 0)
+{
+	return csp::chan_create<
+			t_in, t_in, distinct_t<t_in>, size_t>(budget);
+}/* distinct */
+
 /* ================================
  * print
  * Prints input stream to stdout
+ * Anything with operator<< can be printed, print<line_view>() for
+ *   lines from mmap_cat
  * ================================
  */
-CSP_DECL(print, csp::string, csp::nothing)()
+template <typename t_in> class print_t : public csp::channel<t_in, csp::nothing>
 {
-	csp::string line;
-	while (read(line))
-		std::cout << line << "\n";
+public:
+	void run(std::ostream* out)
+	{
+		t_in line;
+		while (this->read(line))
+			*out << line << "\n";
+	}
+};
+template <typename t_in = csp::string>
+csp::shared_ptr<csp::channel<t_in, csp::nothing, std::ostream*>> print()
+{
+	return csp::chan_create<
+			t_in, csp::nothing, print_t<t_in>, std::ostream*>(&std::cout);
 } // print
 // Prints to stderr
-CSP_DECL(print_log, csp::string, csp::nothing)()
+template <typename t_in = csp::string>
+csp::shared_ptr<csp::channel<t_in, csp::nothing, std::ostream*>> print_log()
 {
-	csp::string line;
-	while (read(line))
-		std::cerr << line << "\n";
+	return csp::chan_create<
+			t_in, csp::nothing, print_t<t_in>, std::ostream*>(&std::cerr);
 } // print_log
 
+/* ================================
+ * uring_write
+ * Writes input to file a line each, replacing what was there
+ * Lines are packed into blocks, and CSP_URING_DEPTH block writes are
+ *   kept in flight through io_uring while more input comes in
+ * Writes each block with write(2) if there is no io_uring or the file
+ *   isn't a regular file, like uring_write("/dev/stdout")
+ * Sets error to 1 if the file can't be opened or a write fails
+ * ================================
+ */
+CSP_DECL(uring_write, csp::string, csp::nothing, const char*, std::atomic<int>*)
+												(const char* file, std::atomic<int>* error)
+{
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		*error = 1;
+		// Read input anyway, a bounded stream would leave the writer stuck
+		csp::string line;
+		while (this->read(line));
+		return;
+	}
+	struct stat st;
+	std::unique_ptr<uring> ring;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode))
+		ring = uring::open(CSP_URING_DEPTH);
+
+	struct write_slot
+	{
+		char* block;
+		uint64_t offset;
+		size_t size;
+		size_t written;
+	};
+	write_slot slots[CSP_URING_DEPTH];
+	std::vector<size_t> idle;
+	for (size_t i = 0; i < CSP_URING_DEPTH; i++)
+	{
+		slots[i] = write_slot{block_pool::get().take(), 0, 0, 0};
+		idle.push_back(i);
+	}
+	if (std::find_if(slots, slots + CSP_URING_DEPTH,
+			[](write_slot& a){ return !a.block; }) != slots + CSP_URING_DEPTH)
+	{
+		// Out of memory, same as not being able to open the file
+		for (write_slot& slot : slots)
+			block_pool::get().give(slot.block);
+		close(fd);
+		*error = 1;
+		csp::string line;
+		while (this->read(line));
+		return;
+	}
+	size_t in_flight = 0;
+	uint64_t offset = 0;
+	bool failed = false;
+	// Set if the ring broke with writes still reading from the blocks
+	bool lost = false;
+
+	// Waits for one write to finish, returns false if none can
+	auto finish_one = [&]() -> bool
+	{
+		uint64_t tag;
+		int result;
+		if (!ring->wait(tag, result))
+		{
+			lost = failed = true;
+			return false;
+		}
+		write_slot& slot = slots[tag];
+		if (result > 0)
+			slot.written += result;
+		else
+			failed = true;
+		// A short write writes the rest
+		if (!failed && slot.written < slot.size)
+		{
+			ring->write(fd, slot.block + slot.written,
+					slot.size - slot.written, slot.offset + slot.written, tag);
+			return true;
+		}
+		in_flight--;
+		idle.push_back(tag);
+		return true;
+	};
+
+	size_t current = idle.back();
+	idle.pop_back();
+	auto submit = [&]()
+	{
+		write_slot& slot = slots[current];
+		slot.offset = offset;
+		slot.written = 0;
+		offset += slot.size;
+		if (ring)
+		{
+			ring->write(fd, slot.block, slot.size, slot.offset, current);
+			in_flight++;
+			while (idle.empty())
+				if (!finish_one())
+					return;
+		}
+		else
+		{
+			while (slot.written < slot.size)
+			{
+				ssize_t amt = ::write(fd, slot.block + slot.written,
+						slot.size - slot.written);
+				if (amt < 0 && errno == EINTR)
+					continue;
+				if (amt <= 0)
+				{
+					failed = true;
+					break;
+				}
+				slot.written += amt;
+			}
+			idle.push_back(current);
+		}
+		current = idle.back();
+		idle.pop_back();
+		slots[current].size = 0;
+	};
+	auto add = [&](const char* data, size_t size)
+	{
+		while (size && !failed)
+		{
+			write_slot& slot = slots[current];
+			size_t amount = std::min(size, CSP_READ_BLOCK - slot.size);
+			memcpy(slot.block + slot.size, data, amount);
+			slot.size += amount;
+			data += amount;
+			size -= amount;
+			if (slot.size == CSP_READ_BLOCK)
+				submit();
+		}
+	};
+
+	// After a failure input is still read and thrown away, a bounded
+	//   stream would otherwise leave the writer stuck
+	std::vector<csp::string> items (this->batch_size());
+	size_t count;
+	while ((count = this->read_batch(items.data(), items.size())))
+		for (size_t i = 0; i < count && !failed; i++)
+		{
+			add(items[i].data(), items[i].size());
+			add("\n", 1);
+		}
+	if (!failed && slots[current].size)
+		submit();
+	while (in_flight && !lost)
+		finish_one();
+
+	if (!lost)
+		for (write_slot& slot : slots)
+			block_pool::get().give(slot.block);
+	close(fd);
+	if (failed)
+		*error = 1;
+} // uring_write
+
 /* ================================
  * vec
  * Sends out items in a vector over a pipe
@@ -0,0 +1,118 @@
+/*
+ * event.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace csp{
+
+// Times to check the condition before going to sleep in the kernel
+// The other thread is usually right around the corner, and sleeping
+//   and waking costs a lot more than a few checks
+#define CSP_SPIN_COUNT 128
+
+// Gets woken up instead of a sleeping thread, used by coroutines in coro.h
+struct event_waiter
+{
+	virtual void wake() = 0;
+	virtual ~event_waiter() {}
+};
+
+// A place for threads to sleep until another thread changes something
+// Waiters spin for a bit, then sleep on a futex
+// A notify can't get lost between checking the condition and sleeping,
+//   notify bumps seq and the futex won't sleep if seq changed since
+class event
+{
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> waiters;
+	// Only one waiter at a time can wait without a thread
+	std::atomic<event_waiter*> async;
+
+	static void pause()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+public:
+	event() : seq(0), waiters(0), async(NULL) {}
+
+	// Returns when ready() returns true
+	template<typename F>
+	void wait(F ready)
+	{
+		for (int i = 0; i < CSP_SPIN_COUNT; i++)
+		{
+			if (ready())
+				return;
+			pause();
+		}
+		while (true)
+		{
+			waiters++;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			uint32_t key = seq.load(std::memory_order_relaxed);
+			if (ready())
+			{
+				waiters--;
+				return;
+			}
+			syscall(SYS_futex, &seq, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+			waiters--;
+		}
+	}
+
+	// Has waiter->wake() called once ready() might be true instead of blocking
+	// Returns false if ready() is already true, waiter won't be woken then
+	// waiter can be woken and gone before this returns,
+	//   so ready() must not use it
+	template<typename F>
+	bool wait_async(event_waiter* waiter, F ready)
+	{
+		async.store(waiter);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (ready())
+			// Take it back, unless notify_all already got to it
+			return async.exchange(NULL) != waiter;
+		return true;
+	}
+
+	// Call after making a waiter's condition true
+	void notify_all()
+	{
+		// Either the waiter sees the change or we see the waiter
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters.load(std::memory_order_relaxed))
+		{
+			seq++;
+			syscall(SYS_futex, &seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+		}
+		if (async.load(std::memory_order_relaxed))
+		{
+			event_waiter* waiter = async.exchange(NULL);
+			if (waiter)
+				waiter->wake();
+		}
+	}
+
+	// True if a thread is sleeping, or about to
+	bool waiting()
+	{
+		return waiters.load(std::memory_order_relaxed) != 0;
+	}
+};
+
+}
+
+#endif /* EVENT_H_ */
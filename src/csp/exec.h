@@ -11,25 +11,17 @@
 #include <atomic>
 #include <stdio.h>
 #include <csp/pipe.h>
+#include <csp/line_reader.h>
 #include <sys/wait.h>
 
 namespace csp{
 
 // Reads FILE into message_stream
+// Nothing has gone through fp's own buffer yet, so its descriptor is
+//   read directly
 void read_file_to(FILE* fp, message_stream<csp::string>* writeto)
 {
-	size_t len = 0;
-	ssize_t amt;
-	char* line = NULL;
-	while ((amt = getline(&line, &len, fp)) != -1)
-	{
-		if (!amt) continue;
-		if (line[amt - 1] == '\n')
-			amt--;
-		writeto->write(csp::string (line, amt));
-	}
-	if (line)
-		free(line);
+	read_lines_to(fileno(fp), writeto);
 }
 // Reads from message_stream into FILE
 void write_file_from(FILE* fp, message_stream<csp::string>* readfrom)
@@ -197,10 +189,10 @@ CSP_DECL(exec_rw, csp::string, csp::string,
 		return;
 	}
 
-	auto thread = std::thread(_bg_read, outfd, csp_output);
+	auto reader = executor::get().run(std::bind(_bg_read, outfd, csp_output));
 	write_file_from(infp, csp_input);
 	pclose(infp);
-	thread.join();
+	reader.wait();
 	waitpid(pid, NULL, 0);
 }
 
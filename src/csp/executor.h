@@ -0,0 +1,132 @@
+/*
+ * executor.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+namespace csp{
+
+// How long a thread over the executor's size waits for work before exiting
+#define CSP_POOL_IDLE_MS 1000
+
+// Runs channels on threads that are kept around and reused
+// Channels block in read() and put(), so every running channel still
+//   needs a thread of its own, but starting one is just handing a task
+//   to a sleeping thread instead of creating a new one
+// Nothing caps how many run at once, a stage can block anywhere, in a
+//   mutex, a pipe or a sleep, and holding back the one that would unblock
+//   it costs more than letting the kernel share the cores
+// As many threads as the hardware has are always kept, threads made
+//   when they are all busy exit after CSP_POOL_IDLE_MS of no work
+// A task that throws has the exception written to stderr, and the
+//   future rethrows it from get()
+class executor
+{
+	std::mutex lock;
+	std::condition_variable work_ready;
+	std::deque<std::packaged_task<void()>> tasks;
+
+	// Threads waiting for a task
+	size_t idle;
+	// Threads alive, and how many of them to keep when idle
+	size_t workers;
+	size_t keep;
+
+	executor() : idle(0), workers(0)
+	{
+		keep = std::thread::hardware_concurrency();
+		if (!keep)
+			keep = 1;
+	}
+
+	void work()
+	{
+		std::unique_lock<std::mutex> ul (lock);
+		while (true)
+		{
+			if (!tasks.empty())
+			{
+				std::packaged_task<void()> task = std::move(tasks.front());
+				tasks.pop_front();
+				ul.unlock();
+				task();
+				ul.lock();
+				continue;
+			}
+
+			idle++;
+			bool got_work = work_ready.wait_for(ul,
+					std::chrono::milliseconds(CSP_POOL_IDLE_MS),
+					[this]{ return !tasks.empty(); });
+			idle--;
+
+			if (!got_work && workers > keep)
+			{
+				workers--;
+				return;
+			}
+		}
+	}
+public:
+	// Never deleted, the threads can outlive static destructors
+	static executor& get()
+	{
+		static executor* result = new executor();
+		return *result;
+	}
+
+	// Runs fn on a thread of its own
+	// The future is ready once fn returns
+	std::future<void> run(std::function<void()> fn)
+	{
+		std::packaged_task<void()> task ([fn]
+		{
+			try
+			{
+				fn();
+			}
+			catch (std::exception& e)
+			{
+				std::cerr << "csp: task threw: " << e.what() << std::endl;
+				throw;
+			}
+			catch (...)
+			{
+				std::cerr << "csp: task threw" << std::endl;
+				throw;
+			}
+		});
+		std::future<void> result = task.get_future();
+
+		std::lock_guard<std::mutex> lg (lock);
+		tasks.push_back(std::move(task));
+
+		// Tasks can block forever waiting on each other,
+		//   so never let one wait for a thread to free up
+		if (tasks.size() > idle)
+		{
+			workers++;
+			std::thread(&executor::work, this).detach();
+		}
+		else
+			work_ready.notify_one();
+		return result;
+	}
+};
+
+}
+
+#endif /* EXECUTOR_H_ */
@@ -0,0 +1,202 @@
+/*
+ * hash_set.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef HASH_SET_H_
+#define HASH_SET_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include <csp/string.h>
+#include <csp/message_stream.h>
+
+namespace csp{
+
+// Spreads the bits of x over the whole word
+// std::hash of integers doesn't change them, which clusters badly
+inline uint64_t hash_mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+// Hashes eight bytes at a time
+inline uint64_t hash_bytes(const char* data, size_t size)
+{
+	uint64_t result = size * 0x9e3779b97f4a7c15ULL;
+	while (size >= 8)
+	{
+		uint64_t word;
+		memcpy(&word, data, 8);
+		result = hash_mix(result ^ word);
+		data += 8;
+		size -= 8;
+	}
+	uint64_t word = 0;
+	// An empty line_view has no data at all
+	if (size)
+		memcpy(&word, data, size);
+	return hash_mix(result ^ word);
+}
+
+// Hash used by hash_set and bloom_filter
+// Overload this for types std::hash doesn't know
+template <typename T>
+uint64_t item_hash(const T& item)
+{
+	return hash_mix(std::hash<T>()(item));
+}
+inline uint64_t item_hash(const csp::string& item)
+{
+	return hash_bytes(item.data(), item.size());
+}
+
+// Open addressing set with linear probing
+// Hashes are kept apart from the items, so a probe only walks through
+//   a few cache lines of hashes and only looks at an item if the
+//   whole hash matches
+template <typename T>
+class hash_set
+{
+	// 0 marks an empty slot, hashes that come out 0 are stored as 1
+	std::vector<uint64_t> hashes;
+	std::vector<T> items;
+	size_t used;
+	size_t mask;
+	// stream_item_size() of every item, so memory an item owns counts
+	size_t item_bytes;
+
+	void grow()
+	{
+		std::vector<uint64_t> old_hashes (hashes.size() * 2);
+		std::vector<T> old_items (items.size() * 2);
+		old_hashes.swap(hashes);
+		old_items.swap(items);
+		mask = hashes.size() - 1;
+
+		for (size_t i = 0; i < old_hashes.size(); i++)
+			if (old_hashes[i])
+			{
+				size_t slot = old_hashes[i] & mask;
+				while (hashes[slot])
+					slot = (slot + 1) & mask;
+				hashes[slot] = old_hashes[i];
+				items[slot] = std::move(old_items[i]);
+			}
+	}
+public:
+	hash_set() : hashes(16), items(16), used(0), mask(15), item_bytes(0) {}
+
+	// Adds item, hash is item_hash(item)
+	// Returns false if it was already in the set
+	bool insert(const T& item, uint64_t hash)
+	{
+		if (!hash)
+			hash = 1;
+		size_t slot = hash & mask;
+		while (hashes[slot])
+		{
+			if (hashes[slot] == hash && items[slot] == item)
+				return false;
+			slot = (slot + 1) & mask;
+		}
+		hashes[slot] = hash;
+		items[slot] = item;
+		item_bytes += stream_item_size(item);
+
+		// Probes get long past about two thirds full
+		if (++used * 3 > hashes.size() * 2)
+			grow();
+		return true;
+	}
+
+	size_t size() const
+	{
+		return used;
+	}
+	// Roughly how much memory the set uses, counting what items own
+	size_t bytes() const
+	{
+		return hashes.size() * sizeof(uint64_t) +
+				(items.size() - used) * sizeof(T) + item_bytes;
+	}
+	// Returns the hash of every item and empties the set
+	// The items are freed before the hashes are gathered, so memory
+	//   only goes down
+	std::vector<uint64_t> take_hashes()
+	{
+		std::vector<T>().swap(items);
+		size_t kept = 0;
+		for (uint64_t a : hashes)
+			if (a)
+				hashes[kept++] = a;
+		hashes.resize(kept);
+		hashes.shrink_to_fit();
+
+		std::vector<uint64_t> result;
+		result.swap(hashes);
+		*this = hash_set();
+		return result;
+	}
+};
+
+// Bloom filter that keeps all the bits for a hash in one cache line
+// Answers "maybe seen" or "definitely not seen" in one memory access
+class bloom_filter
+{
+	// Each block is 512 bits, a cache line
+	struct block { uint64_t bits[8]; };
+	std::vector<block> blocks;
+	size_t mask;
+public:
+	// Bits set per item, 9 bits of the hash pick each one
+	enum { hashes = 6 };
+
+	// Uses about size bytes
+	bloom_filter(size_t size)
+	{
+		size_t count = 1;
+		while (count * 2 * sizeof(block) <= size)
+			count *= 2;
+		blocks.resize(count);
+		memset(blocks.data(), 0, count * sizeof(block));
+		mask = count - 1;
+	}
+
+	// Adds hash to the filter
+	// Returns false if it was definitely not there before
+	bool insert(uint64_t hash)
+	{
+		// Same as hash_set, so hashes taken out of one match
+		if (!hash)
+			hash = 1;
+		block& b = blocks[hash & mask];
+		// The low bits picked the block, mix again for the bits in it
+		uint64_t bits = hash_mix(hash);
+		bool present = true;
+		for (int i = 0; i < hashes; i++)
+		{
+			unsigned bit = bits & 511;
+			bits >>= 9;
+			uint64_t flag = uint64_t(1) << (bit & 63);
+			if (!(b.bits[bit >> 6] & flag))
+			{
+				present = false;
+				b.bits[bit >> 6] |= flag;
+			}
+		}
+		return present;
+	}
+};
+
+}
+
+#endif /* HASH_SET_H_ */
@@ -0,0 +1,263 @@
+/*
+ * line_reader.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef LINE_READER_H_
+#define LINE_READER_H_
+
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+
+#include <csp/string.h>
+#include <csp/message_stream.h>
+
+namespace csp{
+
+// Bytes asked for in each read(2)
+#ifndef CSP_READ_BLOCK
+#define CSP_READ_BLOCK (1 << 18)
+#endif
+// Most free blocks the pool keeps
+#define CSP_POOL_BLOCKS 16
+
+// Free read blocks, so a pipeline started over and over doesn't
+//   allocate a new block every time
+class block_pool
+{
+	std::mutex lock;
+	std::vector<char*> free;
+public:
+	// Never deleted, readers can outlive static destructors
+	static block_pool& get()
+	{
+		static block_pool* pool = new block_pool();
+		return *pool;
+	}
+
+	// Returns a block of CSP_READ_BLOCK bytes, NULL if out of memory
+	char* take()
+	{
+		{
+			std::lock_guard<std::mutex> lg (lock);
+			if (!free.empty())
+			{
+				char* block = free.back();
+				free.pop_back();
+				return block;
+			}
+		}
+		return (char*)malloc(CSP_READ_BLOCK);
+	}
+	void give(char* block)
+	{
+		if (!block)
+			return;
+		{
+			std::lock_guard<std::mutex> lg (lock);
+			if (free.size() < CSP_POOL_BLOCKS)
+			{
+				free.push_back(block);
+				return;
+			}
+		}
+		::free(block);
+	}
+};
+
+// Reads lines out of a file descriptor a block at a time
+// One read(2) brings in many lines, and memchr finds where they end,
+//   so short lines cost a few bytes of copying and not a syscall each
+// A line longer than a block grows the block until it fits
+class line_reader
+{
+	int fd;
+	char* block;
+	size_t capacity;
+	// Bytes before start were already handed out, filled is the end of data
+	size_t start;
+	size_t filled;
+	// Bytes from start to scanned are known to have no newline
+	size_t scanned;
+	bool eof;
+	bool error;
+
+	// Moves what's left to the front and reads more after it
+	// Returns false once there is nothing more to read
+	bool refill()
+	{
+		if (eof)
+			return false;
+		if (start)
+		{
+			memmove(block, block + start, filled - start);
+			filled -= start;
+			scanned -= start;
+			start = 0;
+		}
+		if (filled == capacity)
+		{
+			char* bigger = (char*)malloc(capacity * 2);
+			// Fails like a read would, the lines before it still count
+			if (!bigger)
+			{
+				eof = error = true;
+				return false;
+			}
+			memcpy(bigger, block, filled);
+			release();
+			block = bigger;
+			capacity *= 2;
+		}
+
+		ssize_t amt;
+		do
+			amt = ::read(fd, block + filled, capacity - filled);
+		while (amt < 0 && errno == EINTR);
+		if (amt <= 0)
+		{
+			eof = true;
+			error = amt < 0;
+			return false;
+		}
+		filled += amt;
+		return true;
+	}
+	void release()
+	{
+		if (capacity == CSP_READ_BLOCK)
+			block_pool::get().give(block);
+		else
+			::free(block);
+	}
+public:
+	// Without a block to read into, it fails before reading anything
+	line_reader(int fd) : fd(fd), block(block_pool::get().take()),
+		capacity(block ? CSP_READ_BLOCK : 0), start(0), filled(0), scanned(0),
+		eof(!block), error(!block) {}
+	line_reader(const line_reader&) = delete;
+	line_reader& operator =(const line_reader&) = delete;
+	~line_reader()
+	{
+		release();
+	}
+
+	// Points line at the next line, without its newline
+	// The line is only good until the next call
+	// A last line with no newline still counts
+	// Returns false at the end of the file
+	bool next(const char*& line, size_t& length)
+	{
+		for (;;)
+		{
+			const char* newline = scanned == filled ? NULL : (const char*)
+					memchr(block + scanned, '\n', filled - scanned);
+			if (newline)
+			{
+				line = block + start;
+				length = newline - line;
+				start = scanned = newline - block + 1;
+				return true;
+			}
+			scanned = filled;
+			if (!refill())
+			{
+				if (start == filled)
+					return false;
+				line = block + start;
+				length = filled - start;
+				start = scanned = filled;
+				return true;
+			}
+		}
+	}
+	// True if a read failed, lines before the failure were still read
+	bool failed() const
+	{
+		return error;
+	}
+};
+
+// Collects lines as csp::strings and writes them to a stream a batch
+//   at a time
+// Short lines fit inside the string, only long ones allocate
+class line_batch
+{
+	message_stream<csp::string>* writeto;
+	std::vector<csp::string> lines;
+	size_t count;
+	// Start of a line that went past the end of the last block
+	csp::string partial;
+public:
+	line_batch(message_stream<csp::string>* writeto) :
+		writeto(writeto), lines(CSP_CHUNK_MAX / 8), count(0) {}
+
+	// Adds one line, without its newline
+	void add(const char* line, size_t length)
+	{
+		lines[count++].assign(line, length);
+		if (count == lines.size())
+		{
+			writeto->write_batch(lines.data(), count);
+			count = 0;
+		}
+	}
+	// Adds the lines in the next block of a file
+	// Lines can cross from one block into the next
+	void feed(const char* block, size_t size)
+	{
+		const char* end = block + size;
+		while (block < end)
+		{
+			const char* newline = (const char*)memchr(block, '\n', end - block);
+			if (!newline)
+			{
+				partial.append(block, end - block);
+				return;
+			}
+			if (partial.empty())
+				add(block, newline - block);
+			else
+			{
+				partial.append(block, newline - block);
+				add(partial.data(), partial.size());
+				partial.clear();
+			}
+			block = newline + 1;
+		}
+	}
+	// Adds a last line that had no newline and writes out what's left
+	void finish()
+	{
+		if (!partial.empty())
+		{
+			add(partial.data(), partial.size());
+			partial.clear();
+		}
+		writeto->write_batch(lines.data(), count);
+		count = 0;
+	}
+};
+
+// Writes every line in fd to writeto
+// Returns false if a read failed
+inline bool read_lines_to(int fd, message_stream<csp::string>* writeto)
+{
+	line_reader reader (fd);
+	line_batch batch (writeto);
+	const char* line;
+	size_t length;
+	while (reader.next(line, length))
+		batch.add(line, length);
+	batch.finish();
+	return !reader.failed();
+}
+
+}
+
+#endif /* LINE_READER_H_ */
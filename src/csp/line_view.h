@@ -0,0 +1,188 @@
+/*
+ * line_view.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef LINE_VIEW_H_
+#define LINE_VIEW_H_
+
+#include <memory>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <csp/string.h>
+#include <csp/hash_set.h>
+
+namespace csp{
+
+// A whole file mapped into memory
+// Unmapped once the last shared_ptr to it is gone
+class mapped_file
+{
+	const char* start;
+	size_t length;
+
+	mapped_file(const char* start, size_t length) :
+		start(start), length(length) {}
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator =(const mapped_file&) = delete;
+public:
+	~mapped_file()
+	{
+		if (length)
+			munmap((void*)start, length);
+	}
+
+	// NULL if the file can't be opened or mapped
+	static std::shared_ptr<const mapped_file> open(const char* file)
+	{
+		int fd = ::open(file, O_RDONLY);
+		if (fd < 0)
+			return NULL;
+		struct stat st;
+		if (fstat(fd, &st))
+		{
+			close(fd);
+			return NULL;
+		}
+		// Nothing to map in an empty file, and mmap won't take 0
+		size_t length = st.st_size;
+		void* start = NULL;
+		if (length)
+		{
+			start = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (start == MAP_FAILED)
+			{
+				close(fd);
+				return NULL;
+			}
+			madvise(start, length, MADV_SEQUENTIAL);
+		}
+		close(fd);
+		return std::shared_ptr<const mapped_file>(
+				new mapped_file((const char*)start, length));
+	}
+
+	const char* data() const
+	{
+		return start;
+	}
+	size_t size() const
+	{
+		return length;
+	}
+};
+
+// A line in a mapped file, only a pointer and a length
+// Copying one copies no bytes and touches no reference count
+// Good until the mmap_cat channel that wrote it is gone, the channel
+//   holds the mapping
+// Read only, so stages that change lines, like to_lower, need a csp::string
+class line_view
+{
+	const char* start;
+	size_t count;
+public:
+	enum : size_t { npos = std::string::npos };
+
+	line_view() : start(NULL), count(0) {}
+	line_view(const char* start, size_t length) :
+		start(start), count(length) {}
+
+	const char* data() const
+	{
+		return start;
+	}
+	size_t size() const
+	{
+		return count;
+	}
+	size_t length() const
+	{
+		return count;
+	}
+	bool empty() const
+	{
+		return count == 0;
+	}
+	const char* begin() const
+	{
+		return start;
+	}
+	const char* end() const
+	{
+		return start + count;
+	}
+	const char& operator [](size_t i) const
+	{
+		return start[i];
+	}
+
+	size_t find(const char* str, size_t len) const
+	{
+		if (len == 0)
+			return 0;
+		const char* location = find_bytes(start, count, str, len);
+		if (!location) return npos;
+		return location - start;
+	}
+	size_t find(const char* str) const
+	{
+		return find(str, strlen(str));
+	}
+	size_t find(const std::string& str) const
+	{
+		return find(str.data(), str.size());
+	}
+
+	int compare(const line_view& a) const
+	{
+		size_t common = std::min(count, a.count);
+		int result = common ? memcmp(start, a.start, common) : 0;
+		if (result)
+			return result;
+		return count < a.count ? -1 : count > a.count;
+	}
+	// Copies the bytes out, for stages that need to own or change them
+	csp::string str() const
+	{
+		return csp::string(start, count);
+	}
+	std::string std_string() const
+	{
+		return std::string(start, count);
+	}
+};
+
+inline bool operator ==(const line_view& lh, const line_view& rh)
+{
+	return lh.size() == rh.size() &&
+			(lh.empty() || !memcmp(lh.data(), rh.data(), lh.size()));
+}
+inline bool operator !=(const line_view& lh, const line_view& rh)
+{
+	return !(lh == rh);
+}
+inline bool operator <(const line_view& lh, const line_view& rh)
+{
+	return lh.compare(rh) < 0;
+}
+inline uint64_t item_hash(const line_view& item)
+{
+	return hash_bytes(item.data(), item.size());
+}
+inline std::ostream& operator<< (std::ostream& os, const line_view& line)
+{
+	os.write(line.data(), line.size());
+	return os;
+}
+
+}
+
+#endif /* LINE_VIEW_H_ */
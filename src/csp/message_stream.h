@@ -9,286 +9,731 @@
 #define ONEWAY_CHANNEL_H_
 
 #include <mutex>
-#include <condition_variable>
 #include <vector>
-#include <list>
 #include <atomic>
-#include <sys/syscall.h>
-#include <unistd.h>
+#include <algorithm>
 
 #include <csp/spaghetti.h>
+#include <csp/event.h>
 
 namespace csp{
 
+// Items that are touched by different threads are kept this far apart
+//   so the reader and writer don't fight over the same cache line
+#define CSP_CACHE_LINE 64
+
+// How many bytes an item takes up, used to pick chunk sizes
+// Overload this for types that own memory, like csp::string
+template<typename T>
+size_t stream_item_size(const T&)
+{
+	return sizeof(T);
+}
+
+// One ring of a stream
+// The writer only touches tail, the reader only touches head
+// When the ring fills up the writer makes a bigger one and links it in next,
+//   the reader drains this ring, follows next and deletes this one
+template<typename T>
+struct stream_ring
+{
+	std::atomic<size_t> head;
+	char head_pad[CSP_CACHE_LINE - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> tail;
+	char tail_pad[CSP_CACHE_LINE - sizeof(std::atomic<size_t>)];
+	std::atomic<stream_ring*> next;
+
+	// Capacity is always a power of two so indexes can be masked
+	size_t mask;
+	T* items;
+
+	stream_ring(size_t capacity) : head(0), tail(0), next(NULL),
+			mask(capacity - 1), items(new T[capacity])
+	{}
+	~stream_ring()
+	{
+		delete[] items;
+	}
+};
+
+// Number of empty rings of each size kept around to be used again
+#define CSP_POOL_RINGS 16
+
+// Rings from streams that grew or were deleted are kept here
+// New streams and growing streams take rings from here first,
+//   so a pipeline that is running or started over and over doesn't
+//   have to go through the allocator, and the writer's thread
+//   never has to free what the reader's thread allocated
+template<typename T>
+class ring_pool
+{
+	std::mutex lock;
+	// Indexed by the log2 of the capacity
+	std::vector<stream_ring<T>*> free[sizeof(size_t) * 8];
+
+	static int size_class(size_t capacity)
+	{
+		int result = 0;
+		while ((size_t(1) << result) < capacity)
+			result++;
+		return result;
+	}
+public:
+	// Never deleted, streams can outlive static destructors
+	static ring_pool& get()
+	{
+		static ring_pool* pool = new ring_pool();
+		return *pool;
+	}
+
+	// Returns an empty ring with a capacity of at least capacity
+	stream_ring<T>* take(size_t capacity)
+	{
+		int index = size_class(capacity);
+		{
+			std::lock_guard<std::mutex> lg (lock);
+			if (!free[index].empty())
+			{
+				stream_ring<T>* ring = free[index].back();
+				free[index].pop_back();
+				return ring;
+			}
+		}
+		return new stream_ring<T>(size_t(1) << index);
+	}
+	void give(stream_ring<T>* ring)
+	{
+		// Items left in the ring would keep their memory until reused
+		if (ring->head != ring->tail)
+		{
+			delete ring;
+			return;
+		}
+		ring->head = 0;
+		ring->tail = 0;
+		ring->next = NULL;
+
+		int index = size_class(ring->mask + 1);
+		{
+			std::lock_guard<std::mutex> lg (lock);
+			if (free[index].size() < CSP_POOL_RINGS)
+			{
+				free[index].push_back(ring);
+				return;
+			}
+		}
+		delete ring;
+	}
+};
+
 // Typical programming channel
 // Blocks reading till stuff is written to the channel
 // A stream will have readers and writers accessing through different threads
-// This tries to not use locks when necessary, for performance
+// This is a single-producer single-consumer queue, there are no locks
+//   unless a reader has to sleep or there are multiple writers
+// Multiple writers can each get their own lane with add_lane(),
+//   the reader of this stream reads from all of them
 template<typename T>
 class message_stream
 {
 private:
-	// These are the indexes to where we are reading/writing in the cache
-	uint32_t readhead, writehead;
-	std::atomic<uint32_t> writehead_finished;
-
-	// This is where the items are stored to be read
-	// The linked list stores an array of data, the cache
-	// The cache is used because the list must be locked
-	//   every time it is written to and locking on every write is expensive
-	// ===== -> ===== -> ===== -> ===-- -> 0
-	typedef std::array<T, CSP_CACHE_DEFAULT> stream_cache;
-	std::list<stream_cache> list;
-
-	// Since the variable isn't atomic, and we want the length to be accurate
-	// This mutex must be locked every time the list is written
-	size_t list_size;
-	std::mutex list_lock;
-
-	// Used by wait_lock to block and resume
-	std::mutex wait_lock_ml;
-
-	// Threads waiting for input in wait_write()
-	std::atomic<int> waiting;
+	// Reader's side
+	// read_tail is the last tail the reader saw, so it doesn't have to
+	//   look at the writer's cache line for every item
+	stream_ring<T>* read_ring;
+	size_t read_tail;
+	char read_pad[CSP_CACHE_LINE];
+
+	// Writer's side, same thing with write_head
+	stream_ring<T>* write_ring;
+	size_t write_head;
+	// Number of writes since the readers were last woken up
+	size_t unnotified;
+	// Average item size and how much to grow chunks by, for adapt_chunk()
+	size_t item_bytes;
+	size_t wait_boost;
+	char write_pad[CSP_CACHE_LINE];
+
+	// Only locked when there are multiple writers
+	std::mutex write_lock;
+
+	// Readers sleep on this in wait_write() until there is input
+	event readable;
+
+	// Lanes are kept in a list starting at the stream they feed
+	// Lanes are never removed until that stream is deleted
+	std::atomic<message_stream*> next_lane;
+	std::mutex lane_lock;
+	// The lane the reader last got an item from
+	message_stream* read_from;
+	// False if a lane's writer is done and it can be given to another
+	std::atomic_bool in_use;
+	// Lanes whose writers woke the reader, so an empty read looks at
+	//   those instead of every lane
+	// Writers push onto ready_lanes, the reader takes them all at once
+	//   into ready_taken and goes through them from there
+	std::atomic<message_stream*> ready_lanes;
+	message_stream* ready_taken;
+	// Next lane in ready_lanes or ready_taken
+	message_stream* ready_next;
+	// True while this lane is in ready_lanes or ready_taken
+	std::atomic_bool ready_queued;
+
+	// Most items the writer may get ahead of the reader, 0 if unlimited
+	size_t capacity;
+	// The reader checks for a blocked writer every time head passes this
+	size_t wake_mask;
+	// The writer sleeps on this when the stream is full
+	event writable;
 public:
-	T last_read;
-
-	// Wait on this for input if we are waiting for writes
-	std::condition_variable wait_lock;
-
 	std::mutex read_lock;
 
 	// This is a hint, namely from parallel.h functions,
 	//   that this should always lock when writing items
 	bool always_lock;
+	// Same for reading, set when several readers share this stream
+	bool always_lock_read;
 
 	// This tells us to unbuffer output
-	// Reads are blocked until a cache line fills up if false
+	// Waiting readers are not woken until a cache line fills up if false
 	bool unbuffered;
 
 	std::atomic_bool finished;
 
-	message_stream() : readhead(0), writehead(0), writehead_finished(0),
-			list_size(0), waiting(0), always_lock(false), unbuffered(false),
-			finished(false)
-	{}
-
-	// Returns true if there are items remaining in the list
-	// Assumes mutex is locked
-	bool items_remaining()
+	// Number of writes between waking up the reader
+	// Stages also use this as the number of items to read at once
+	std::atomic<size_t> chunk;
+	// Set to have the writer pick chunk by itself
+	bool adaptive;
+
+	// The stream this lane writes into, NULL if this isn't a lane
+	message_stream* parent;
+
+	message_stream(size_t capacity = 0) : read_tail(0), write_head(0),
+			unnotified(0), next_lane(NULL), read_from(this),
+			in_use(true), ready_lanes(NULL), ready_taken(NULL),
+			ready_next(NULL), ready_queued(false), capacity(0), wake_mask(0),
+			always_lock(false), always_lock_read(false),
+			unbuffered(false), finished(false),
+			chunk(CSP_CACHE_DEFAULT), adaptive(false), parent(NULL)
 	{
-		bool converged = (list_size == 1 && readhead == writehead_finished);
-		if (finished)
-			// Finished if list size is zero or reading/writing elements same
-			return !(converged || list_size == 0);
-		return true;
+		item_bytes = sizeof(T);
+		wait_boost = 1;
+		read_ring = write_ring = ring_pool<T>::get().take(CSP_CACHE_DEFAULT * 2);
+		if (capacity)
+			set_capacity(capacity);
 	}
-
-	// Returns false if item could not be read safely
-	// True on success
-	bool read_list(bool locked)
+	~message_stream()
 	{
-		if (readhead == CSP_CACHE_DEFAULT)
+		while (read_ring)
 		{
-			readhead = 0;
-			if (!locked)
-				lock_this();
-			list.pop_front();
-			list_size--;
-
-			if (!locked)
-				assert(list_size >= 1);
-
-			if (!locked)
-				unlock_this();
+			stream_ring<T>* next = read_ring->next;
+			ring_pool<T>::get().give(read_ring);
+			read_ring = next;
 		}
+		if (!parent)
+			for (message_stream* lane = next_lane; lane;)
+			{
+				message_stream* next = lane->next_lane;
+				delete lane;
+				lane = next;
+			}
+	}
 
-		if (list_size == 0 || (list_size == 1 && readhead >= writehead))
-			return false;
+	// Limits how far the writer can get ahead of the reader
+	// Writers block when the stream is full instead of using more memory
+	// Lanes get the same capacity, each
+	// Must be called before anything is written
+	void set_capacity(size_t items)
+	{
+		size_t size = 1;
+		while (size < items)
+			size *= 2;
+		size_t step = 1;
+		while (step * 2 <= items / 2)
+			step *= 2;
+
+		capacity = items;
+		wake_mask = step - 1;
+		if (items && read_ring->mask + 1 < size)
+		{
+			ring_pool<T>::get().give(read_ring);
+			read_ring = write_ring = ring_pool<T>::get().take(size);
+		}
+	}
 
-		std::swap(last_read, list.front()[readhead++]);
-		return true;
+	// Sets the number of items in a chunk
+	// Call before anything is written so the ring can be sized to match
+	void set_chunk(size_t items)
+	{
+		chunk = items? items : 1;
+		size_t size = 1;
+		while (size < chunk * 2)
+			size *= 2;
+		if (!capacity && read_ring->mask + 1 < size)
+		{
+			ring_pool<T>::get().give(read_ring);
+			read_ring = write_ring = ring_pool<T>::get().take(size);
+		}
 	}
-	// Returns true on success, false on failure
-	// Will not read and fail if there are not enough entries in the list
-	// The locked variable tells us if the list mutex is locked
-	// If it is locked, we should not lock it again to prevent deadlocks
-	bool do_read_simple(bool locked)
+
+	// Gives a writer a queue of its own that the reader of this stream reads
+	// Writing to a lane never contends with the other writers
+	// Call done() on the lane when finished writing, the lane will be reused
+	//   but this stream still has to be finished with done()
+	message_stream* add_lane()
 	{
-		// The list is empty or may not fully populated
-		// If the list is not fully populated we might read uncommitted items
-		//   in the cache in the list
-		if (list_size <= 2)
-			return false;
+		std::lock_guard<std::mutex> lg (lane_lock);
+
+		// Reuse a lane someone else finished with
+		for (message_stream* lane = next_lane; lane; lane = lane->next_lane)
+			if (!lane->in_use)
+			{
+				lane->in_use = true;
+				return lane;
+			}
 
-		return read_list(locked);
+		message_stream* lane = new message_stream(capacity);
+		lane->parent = this;
+		lane->unbuffered = unbuffered;
+		lane->set_chunk(chunk);
+		lane->adaptive = adaptive;
+		lane->next_lane = next_lane.load();
+		next_lane.store(lane, std::memory_order_release);
+		return lane;
 	}
-	// Reads items from the cache that may not be fully populated
-	// Assumes mutex is locked, items remain, and list size is 1 or 0
-	// Returns true if read success, false if no items remain in list
-	bool do_read_tight()
+
+	// Returns true if the reader has something to look at
+	// Only call from the reading thread
+	// Lanes are only seen once their writer wakes the reader, like a
+	//   sleeping reader only wakes once a chunk is written
+	bool items_remaining()
 	{
-		if (list_size == 0 || readhead == writehead)
-		{
-			wait:
-			unlock_this();
-			wait_write();
-			lock_this();
+		return ring_remaining() || read_from->ring_remaining() ||
+				ready_taken || ready_lanes.load(std::memory_order_acquire);
+	}
 
-			if (!items_remaining())
-				return false;
-		}
-		assert(list_size != 0);
-		if (!read_list(true))
-			goto wait;
-		return true;
+	// Returns false if there was nothing to read right now
+	bool try_read(T& t)
+	{
+		return try_read_batch(&t, 1) != 0;
 	}
-	// Returns false if there are no items left
-	bool safe_read(T& t)
+	// Returns how many items were read without waiting
+	size_t try_read_batch(T* t, size_t max)
 	{
-		lock_this();
+		size_t count = read_from->pop_batch(t, max);
+		if (count)
+			return count;
 
-		if (!do_read_simple(true))
+		// This stream's own ring, then the lanes that woke the reader
+		if (read_from != this && (count = pop_batch(t, max)))
 		{
-			// Are we finished?
-			if (!items_remaining() || !do_read_tight())
+			read_from = this;
+			return count;
+		}
+		while (message_stream* lane = next_ready())
+			if ((count = lane->pop_batch(t, max)))
 			{
-				unlock_this();
-				return false;
+				read_from = lane;
+				return count;
 			}
-		}
 
-		t = std::move(last_read);
-		unlock_this();
-		return true;
+		// Once finished, the last look goes through every lane
+		if (finished.load(std::memory_order_acquire))
+			for (message_stream* lane = next_lane.load(std::memory_order_acquire);
+					lane; lane = lane->next_lane.load(std::memory_order_acquire))
+				if ((count = lane->pop_batch(t, max)))
+				{
+					read_from = lane;
+					return count;
+				}
+		return 0;
 	}
 	// Returns false if no items remaining to read
 	bool read(T& t)
 	{
-		if (!do_read_simple(false))
+		if (always_lock_read)
 			return safe_read(t);
-		t = std::move(last_read);
-		return true;
+		return read_unlocked(t);
 	}
-
-	T& get_write_reference(bool locked)
+	// Reads everything available up to max items into t
+	// Blocks until there is at least one item
+	// Returns how many items were read, 0 if no items remaining to read
+	size_t read_batch(T* t, size_t max)
 	{
-		// Is the list empty?
-		if (list_size == 0)
+		if (always_lock_read)
+			return safe_read_batch(t, max);
+		return read_batch_unlocked(t, max);
+	}
+	// Needed if multiple threads are reading this stream
+	bool safe_read(T& t)
+	{
+		return safe_read_batch(&t, 1) != 0;
+	}
+	// Items are taken under read_lock, but nobody waits for more while
+	//   holding it, so the other readers can take what comes in meanwhile
+	size_t safe_read_batch(T* t, size_t max)
+	{
+		while (true)
 		{
-			if (!locked)
-				lock_this();
-			list.resize(1);
-			if (!locked)
-				unlock_this();
-			assert(writehead == 0);
+			{
+				std::lock_guard<std::mutex> lg (read_lock);
+				size_t count = try_read_batch(t, max);
+				if (count)
+					return count;
+				if (finished)
+					return try_read_batch(t, max);
+			}
+			readable.wait([this]{ return finished || shared_remaining(); });
 		}
-		// Is the cache full?
-		if (writehead == CSP_CACHE_DEFAULT)
+	}
+	// Versions of read() and read_batch() for when only one thread reads
+	bool read_unlocked(T& t)
+	{
+		while (!try_read(t))
 		{
-			writehead = 0;
-
-			// Add in another cache in the list
-			if (!locked)
-				lock_this();
-
-			list_size++;
-			list.emplace_back();
-
-			assert(list_size > 1);
-
-			if (!locked)
-				unlock_this();
-			// A cache line has been filled, so blocked readers should be notified
-			notify_readers();
+			// The writer sets finished after its last write,
+			//   so look one more time before giving up
+			if (finished)
+				return try_read(t);
+			wait_write();
 		}
-		// This go last because list_size gets updated during the lock
-		// write() needs this updated variable so we don't have an old value
-		//   and write to the front of the list
-		return list.back()[writehead++];
+		return true;
 	}
-	// Safely return the reference to the place to write in the cache line
-	// Assumes lock is locked
-	T& safe_reference()
+	size_t read_batch_unlocked(T* t, size_t max)
 	{
-		// If the list is empty, create it
-		if (list_size == 0)
+		size_t count;
+		while (!(count = try_read_batch(t, max)))
 		{
-			list.resize(1);
-			list_size++;
-			writehead = 0;
+			if (finished)
+				return try_read_batch(t, max);
+			wait_write();
 		}
-		return get_write_reference(true);
+		return count;
 	}
-	// Returns true on success, false on failure
+
 	// Write item to the stream
 	void write(const T& t)
 	{
-		// Be sure to safely write when there are few items in the list
-		//   as the front of the list will be written to
-		//   and there might be a reader waiting
-		if (always_lock || list_size <= 2)
+		if (always_lock)
 		{
 			lock_this();
-			safe_reference() = t;
+			push(t);
 			unlock_this();
-			if (unbuffered)
-				notify_readers();
 		}
 		else
-			get_write_reference(false) = t;
+			push(t);
 	}
 	void write(T&& t)
 	{
-		if (always_lock || list_size <= 2)
+		if (always_lock)
 		{
 			lock_this();
-			safe_reference() = std::move(t);
+			push(std::move(t));
 			unlock_this();
-			if (unbuffered)
-				notify_readers();
 		}
 		else
-			get_write_reference(false) = std::move(t);
+			push(std::move(t));
+	}
+	// Moves count items from t into the stream
+	void write_batch(T* t, size_t count)
+	{
+		if (always_lock)
+		{
+			lock_this();
+			push_batch(t, count);
+			unlock_this();
+		}
+		else
+			push_batch(t, count);
 	}
 
 	void done()
 	{
-		writehead_finished = writehead;
-		finished = true;
-		while (waiting)
+		if (parent)
 		{
-			wait_lock.notify_all();
-			pthread_yield();
+			// Items short of a chunk would wait for some other lane to
+			//   wake the reader
+			wake_reader();
+			in_use = false;
+			return;
 		}
+		finished = true;
+		readable.notify_all();
+	}
+	// Lets a stream that was finished and read to the end be written again
+	// Nothing may be reading or writing it when this is called
+	void reopen()
+	{
+		finished = false;
 	}
 
 	void lock_this()
 	{
-		list_lock.lock();
+		write_lock.lock();
 	}
 	void unlock_this()
 	{
-		list_lock.unlock();
+		write_lock.unlock();
 	}
 	void notify_readers()
 	{
-		if (waiting)
-			wait_lock.notify_all();
+		readable.notify_all();
 	}
 	void wait_write()
 	{
-		waiting++;
-		if (finished)
+		// Halt until a writer unlocks us
+		readable.wait([this]{ return finished || items_remaining(); });
+	}
+
+	// Writes without blocking
+	// Returns false and leaves t alone if a bounded stream is full
+	bool try_write(T&& t)
+	{
+		if (always_lock)
+			lock_this();
+		bool result = has_space();
+		if (result)
+			push(std::move(t));
+		else
+			// The reader might be asleep waiting for the rest of a cache line
+			wake_reader();
+		if (always_lock)
+			unlock_this();
+		return result;
+	}
+	// Returns true if a write wouldn't block
+	// Only call from the writing thread
+	bool has_space()
+	{
+		if (!capacity)
+			return true;
+		size_t tail = write_ring->tail.load(std::memory_order_relaxed);
+		if (tail - write_head < capacity)
+			return true;
+		write_head = write_ring->head.load(std::memory_order_acquire);
+		return tail - write_head < capacity;
+	}
+
+	// Versions of wait_write() and wait_space() for coroutines
+	// waiter gets woken instead, returns false if there is no need to wait
+	bool wait_write_async(event_waiter* waiter)
+	{
+		return readable.wait_async(waiter,
+				[this]{ return finished || items_remaining(); });
+	}
+	bool wait_space_async(event_waiter* waiter)
+	{
+		return writable.wait_async(waiter, [this]{ return has_space(); });
+	}
+
+private:
+	// items_remaining() for a reader that doesn't hold read_lock
+	// Another reader holding it is about to take what's there, so that
+	//   counts too, the caller looks again once it gets the lock
+	bool shared_remaining()
+	{
+		std::unique_lock<std::mutex> lg (read_lock, std::try_to_lock);
+		return !lg.owns_lock() || items_remaining();
+	}
+	bool ring_remaining()
+	{
+		return read_ring->tail.load(std::memory_order_acquire) !=
+				read_ring->head.load(std::memory_order_relaxed) ||
+				read_ring->next.load(std::memory_order_acquire);
+	}
+	// Reads this stream's own ring
+	// Returns false if there was nothing to read right now
+	bool pop(T& t)
+	{
+		return pop_batch(&t, 1) != 0;
+	}
+	// Reads as much as is available from this stream's own ring, up to max
+	// Returns how many items were read
+	size_t pop_batch(T* t, size_t max)
+	{
+		stream_ring<T>* ring = read_ring;
+		size_t head = ring->head.load(std::memory_order_relaxed);
+		if (read_tail - head < max)
+		{
+			read_tail = ring->tail.load(std::memory_order_acquire);
+			if (head == read_tail)
+			{
+				stream_ring<T>* next = ring->next.load(std::memory_order_acquire);
+				if (!next)
+					return 0;
+
+				// The writer has moved on, but it might have written to
+				//   this ring right before it did
+				read_tail = ring->tail.load(std::memory_order_acquire);
+				if (head == read_tail)
+				{
+					read_ring = next;
+					read_tail = 0;
+					ring_pool<T>::get().give(ring);
+					return pop_batch(t, max);
+				}
+			}
+		}
+
+		size_t count = std::min(read_tail - head, max);
+		for (size_t i = 0; i < count; i++)
+			t[i] = std::move(ring->items[(head + i) & ring->mask]);
+		ring->head.store(head + count, std::memory_order_release);
+
+		// Let a blocked writer know there is space now
+		// Only checked every so often, the writer waits for the next check
+		if (capacity && ((head + count) & ~wake_mask) != (head & ~wake_mask))
+			writable.notify_all();
+		return count;
+	}
+
+	// Blocks the writer until the reader makes space
+	// Returns the reader's new head
+	size_t wait_space(size_t tail)
+	{
+		stream_ring<T>* ring = write_ring;
+
+		// The reader might be asleep waiting for the rest of a cache line
+		wake_reader();
+
+		size_t head = 0;
+		writable.wait([&]{
+			head = ring->head.load(std::memory_order_acquire);
+			return tail - head < capacity;
+		});
+		return head;
+	}
+	// Picks a chunk size from how big items are and how often the reader sleeps
+	// Aims for CSP_CHUNK_BYTES of items per chunk, but every chunk that finds
+	//   the reader asleep doubles that, since waking it is what costs
+	// last_bytes is stream_item_size() of the newest item, taken before
+	//   it was published, since the reader may be moving it out by now
+	void adapt_chunk(size_t last_bytes)
+	{
+		item_bytes = (item_bytes * 7 + last_bytes) / 8;
+
+		message_stream* reader = parent? parent : this;
+		if (reader->readable.waiting())
 		{
-			waiting = false;
+			if (wait_boost < 8)
+				wait_boost *= 2;
+		}
+		else if (wait_boost > 1)
+			wait_boost /= 2;
+
+		size_t items = CSP_CHUNK_BYTES * wait_boost / std::max<size_t>(item_bytes, 1);
+		chunk.store(std::max<size_t>(CSP_CHUNK_MIN,
+				std::min<size_t>(items, CSP_CHUNK_MAX)), std::memory_order_relaxed);
+	}
+	void wake_reader()
+	{
+		unnotified = 0;
+		if (parent)
+		{
+			parent->mark_ready(this);
+			parent->notify_readers();
+		}
+		else
+			notify_readers();
+	}
+	// Puts a lane on ready_lanes, unless it's there already
+	void mark_ready(message_stream* lane)
+	{
+		// The reader clears ready_queued before reading the lane, so
+		//   either it sees these items or the lane goes on again
+		if (lane->ready_queued.exchange(true))
 			return;
+		message_stream* head = ready_lanes.load(std::memory_order_relaxed);
+		do
+			lane->ready_next = head;
+		while (!ready_lanes.compare_exchange_weak(head, lane,
+				std::memory_order_release, std::memory_order_relaxed));
+	}
+	// Next lane a writer woke the reader for, NULL if there are none
+	// Only call from the reading thread
+	message_stream* next_ready()
+	{
+		if (!ready_taken)
+			ready_taken = ready_lanes.exchange(NULL, std::memory_order_acquire);
+		message_stream* lane = ready_taken;
+		if (lane)
+		{
+			ready_taken = lane->ready_next;
+			lane->ready_queued.store(false);
 		}
+		return lane;
+	}
 
-		// Halt until a writer unlocks us
-		std::unique_lock<std::mutex> ul (wait_lock_ml);
-		wait_lock.wait(ul);
-		waiting--;
+	// Makes sure there is space to write at tail, waiting or growing if not
+	// Returns how many items can be written before checking again
+	size_t reserve(size_t& tail)
+	{
+		stream_ring<T>* ring = write_ring;
+		size_t limit = capacity? capacity : ring->mask + 1;
+		if (tail - write_head >= limit)
+		{
+			write_head = ring->head.load(std::memory_order_acquire);
+			// Is the stream full?
+			if (capacity && tail - write_head >= limit)
+				write_head = wait_space(tail);
+			// Is the ring full?
+			else if (tail - write_head >= limit)
+			{
+				// The reader is behind, give it a bigger ring to catch up with
+				ring = ring_pool<T>::get().take((ring->mask + 1) * 2);
+				write_ring->next.store(ring, std::memory_order_release);
+				write_ring = ring;
+				write_head = 0;
+				tail = 0;
+				return ring->mask + 1;
+			}
+		}
+		return limit - (tail - write_head);
+	}
+
+	template<typename U>
+	void push(U&& t)
+	{
+		size_t tail = write_ring->tail.load(std::memory_order_relaxed);
+		reserve(tail);
+
+		size_t bytes = adaptive ? stream_item_size(t) : 0;
+		stream_ring<T>* ring = write_ring;
+		ring->items[tail & ring->mask] = std::forward<U>(t);
+		ring->tail.store(tail + 1, std::memory_order_release);
+
+		// Waking the reader is the expensive part, do it once per chunk
+		if (unbuffered || ++unnotified >= chunk.load(std::memory_order_relaxed))
+		{
+			if (adaptive)
+				adapt_chunk(bytes);
+			wake_reader();
+		}
+	}
+	void push_batch(T* t, size_t count)
+	{
+		while (count)
+		{
+			size_t tail = write_ring->tail.load(std::memory_order_relaxed);
+			size_t amount = std::min(reserve(tail), count);
+
+			size_t bytes = adaptive ? stream_item_size(t[amount - 1]) : 0;
+			stream_ring<T>* ring = write_ring;
+			for (size_t i = 0; i < amount; i++)
+				ring->items[(tail + i) & ring->mask] = std::move(t[i]);
+			ring->tail.store(tail + amount, std::memory_order_release);
+
+			t += amount;
+			count -= amount;
+			unnotified += amount;
+			if (unbuffered || unnotified >= chunk.load(std::memory_order_relaxed))
+			{
+				if (adaptive)
+					adapt_chunk(bytes);
+				wake_reader();
+			}
+		}
 	}
 };
 
@@ -8,6 +8,10 @@
 #ifndef PARALLELIZE_H_
 #define PARALLELIZE_H_
 
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
 #include <csp/pipe.h>
 
 namespace csp {
@@ -16,6 +20,8 @@ namespace csp {
  * Used to make the processing of input happen over multiple threads
  *   at the expense of making output unordered
  * Should only be used on channels whose input processing is slow
+ * Workers all read this channel's input and take the next item
+ *   whenever they're free, so slow items or workers don't hold up the rest
  * ================================================================
  */
 template <typename t_in, typename t_out, typename... args>
@@ -30,23 +36,42 @@ public:
 
 		chans.resize(threadcount);
 
+		// Coroutines can't share a stream, they only wait on it one at a time
+		bool shared = !channel->launcher;
+		this->wait_input();
+		if (shared)
+			this->csp_input->always_lock_read = true;
+
 		for (auto& a : chans)
 		{
-			if (!csp::is_nothing<t_out>::value)
-				this->csp_output->always_lock = true;
 			delete a.csp_output;
 			delete a.csp_input;
-			a.csp_output = this->csp_output;
+			// Every worker writes to its own lane so they never wait on each other
+			if (!csp::is_nothing<t_out>::value)
+				a.csp_output = this->csp_output->add_lane();
 			a.manage_output = false;
-			a.csp_input = new csp::message_stream<t_in>();
-			a.manage_input = true;
+			if (shared)
+			{
+				a.csp_input = this->csp_input;
+				a.manage_input = false;
+			}
+			else
+			{
+				a.csp_input = new csp::message_stream<t_in>();
+				a.manage_input = true;
+			}
 
 			a.arguments = channel->arguments;
 			a.start = channel->start;
+			a.launcher = channel->launcher;
 
 			a.start_background();
 		}
 
+		if (shared)
+			return;
+
+		// Otherwise hand out items round-robin to each worker's own input
 		t_in current;
 		int write_to_index = 0;
 		while (this->read(current))
@@ -81,36 +106,197 @@ csp::shared_ptr<csp::channel<
 
 }/* parallel */
 
+/* ================================================================
+ * ordered_parallel
+ * Like parallel, but output comes out in the same order as the input
+ * Input is split into numbered batches, each worker runs the batches it
+ *   takes through a copy of the channel of its own and the output of a
+ *   batch is held until all the batches before it are written
+ * Channels that remember things between items, like uniq, only see
+ *   one batch at a time
+ * ================================================================
+ */
+// Batches each thread can have finished or in progress before the
+//   oldest one is written, bounds how much output is held
+#define CSP_REORDER_WINDOW 4
+
+template <typename t_in, typename t_out, typename... args>
+class ordered_parallel_t : public
+	csp::channel<
+		t_in, t_out,  int, csp::channel<t_in,t_out,args...>*>
+{
+public:
+	void run(int threadcount, csp::channel<t_in,t_out,args...>* channel)
+	{
+		size_t batch = this->batch_size();
+		size_t window = threadcount * CSP_REORDER_WINDOW;
+
+		// Held while reading a batch, so batches are numbered in input order
+		std::mutex input_lock;
+		size_t next_batch = 0;
+
+		// Held while writing output, and for everything below
+		std::mutex order_lock;
+		// Signaled when the oldest batch is written
+		std::condition_variable room;
+		size_t written = 0;
+		std::map<size_t, std::vector<t_out>> finished;
+
+		auto work = [&]
+		{
+			std::vector<t_in> items (batch);
+			std::vector<t_out> out (batch);
+			// Every batch this thread takes runs through the same channel,
+			//   its streams are reopened after each one
+			csp::channel<t_in,t_out,args...> a;
+			a.csp_input = new csp::message_stream<t_in>();
+			a.manage_input = true;
+			a.launcher = channel->launcher;
+			while (true)
+			{
+				size_t index;
+				size_t count = 0;
+				{
+					std::lock_guard<std::mutex> lg (input_lock);
+					{
+						std::unique_lock<std::mutex> ul (order_lock);
+						room.wait(ul, [&]{ return next_batch - written < window; });
+					}
+					// read_batch returns whatever is there, often a single
+					//   item, so keep reading until the batch is full
+					size_t got;
+					while (count < batch &&
+							(got = this->read_batch(&items[count], batch - count)))
+						count += got;
+					if (!count)
+						return;
+					index = next_batch++;
+				}
+
+				// Run the batch through this thread's channel
+				a.csp_input->write_batch(items.data(), count);
+				a.csp_input->done();
+				a.arguments = channel->arguments;
+				a.start = channel->start;
+				a.do_start();
+
+				std::vector<t_out> result;
+				while ((count = a.csp_output->read_batch(out.data(), batch)))
+					std::move(out.begin(), out.begin() + count,
+							std::back_inserter(result));
+				// The channel may not have read all of its input
+				while (a.csp_input->read_batch(items.data(), batch))
+					;
+				a.csp_input->reopen();
+				a.csp_output->reopen();
+
+				std::lock_guard<std::mutex> lg (order_lock);
+				if (index != written)
+				{
+					finished[index] = std::move(result);
+					continue;
+				}
+
+				// Write this batch and any after it that were waiting on it
+				while (true)
+				{
+					this->put_batch(result.data(), result.size());
+					written++;
+					auto next = finished.find(written);
+					if (next == finished.end())
+						break;
+					result = std::move(next->second);
+					finished.erase(next);
+				}
+				room.notify_all();
+			}
+		};
+
+		std::vector<std::future<void>> workers;
+		for (int i = 1; i < threadcount; i++)
+			workers.push_back(executor::get().run(work));
+		work();
+		for (auto& w : workers)
+			w.wait();
+	}
+};
+template <typename t_in, typename t_out, typename... t_args>
+csp::shared_ptr<csp::channel<
+	t_in, t_out, int,
+	csp::channel<t_in,t_out,t_args...>*
+	>>
+	ordered_parallel(int numthreads, csp::shared_ptr<csp::channel<t_in,t_out,t_args...>>&& channel)
+{
+	static_assert(!csp::is_nothing<t_in>::value,
+			"ordered_parallel needs an input channel");
+	static_assert(!csp::is_nothing<t_out>::value,
+			"ordered_parallel needs an output channel");
+
+	using type = csp::channel<
+			t_in,t_out,int,csp::channel<t_in,t_out,t_args...>*>;
+
+	auto a = csp::make_shared<type>();
+	a->arguments = std::make_tuple(numthreads, channel.get());
+	a->start = (void(type::*)(int, csp::channel<t_in,t_out,t_args...>*))
+			&ordered_parallel_t<t_in,t_out,t_args...>::run;
+	return a;
+
+}/* ordered_parallel */
+
 /* ================================================================
  * schedule
  * For every input read,
  *   a channel is created with the value overloaded into its arguments
+ * At most max of the channels run at once, 0 for no limit
+ * Channels are let go as soon as they finish, so memory stays flat
+ *   however much input there is
  * ================================================================
  */
 template <typename t_in, typename t_out>
 class schedule_t : public csp::channel<t_in,t_out>
 {
 public:
-	void run(csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*functor)(t_in))
+	void run(csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*functor)(t_in),
+			size_t max)
 	{
 		using created_channel_t = csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>;
-		// Make sure writes are safe since there are multiple writers
-		this->csp_output->always_lock = true;
 
-		std::vector<created_channel_t> channels;
+		std::mutex lock;
+		// Signaled when a channel finishes
+		std::condition_variable slot;
+		size_t running = 0;
+
 		t_in in;
 		while (this->read(in))
 		{
 			// Create the channel and set it up
-			channels.push_back(created_channel_t(functor(in)));
-			channels.back()->manage_output = false;
-			delete channels.back()->csp_output;
-			channels.back()->csp_output = this->csp_output;
-			channels.back()->background = true;
-
-			// Make channel run in background
-			channels.back()->start_background();
+			// Each one gets a lane to write to since there are multiple writers
+			// Lanes of channels that have finished get reused
+			created_channel_t chan (functor(in));
+			chan->manage_output = false;
+			delete chan->csp_output;
+			chan->csp_output = this->csp_output->add_lane();
+
+			{
+				std::unique_lock<std::mutex> ul (lock);
+				slot.wait(ul, [&]{ return !max || running < max; });
+				running++;
+			}
+
+			// Make channel run in background, on a reused thread
+			executor::get().run([chan, &lock, &slot, &running]() mutable
+			{
+				chan->do_start();
+				chan = created_channel_t();
+
+				std::lock_guard<std::mutex> lg (lock);
+				running--;
+				slot.notify_all();
+			});
 		}
+
+		std::unique_lock<std::mutex> ul (lock);
+		slot.wait(ul, [&]{ return running == 0; });
 	}
 };
 // Creation function
@@ -121,19 +307,21 @@ csp::shared_ptr<csp::channel
 <
 	t_in,
 	t_out,
-	csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*)(t_in)
+	csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*)(t_in),
+	size_t
 >>
-	schedule(csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*functor)(t_in))
+	schedule(csp::shared_ptr<csp::channel<csp::nothing, t_out, t_in>>(*functor)(t_in),
+			size_t max = 0)
 {
 	static_assert(!csp::is_nothing<t_in>::value,
 			"schedule needs input");
 
 	using type = csp::channel<
-			t_in,t_out,decltype(functor)>;
+			t_in,t_out,decltype(functor),size_t>;
 
 	auto a = csp::make_shared<type>();
-	a->arguments = std::make_tuple(functor);
-	a->start = (void(type::*)(decltype(functor)))
+	a->arguments = std::make_tuple(functor, max);
+	a->start = (void(type::*)(decltype(functor), size_t))
 			&schedule_t<t_in,t_out>::run;
 	return a;
 }/* schedule */
@@ -9,11 +9,18 @@
 #define CSP_H_
 
 #include <vector>
-#include <thread>
+#include <memory>
+#include <functional>
 #include <algorithm>
 #include <cassert>
 
 #include <csp/message_stream.h>
+#include <csp/executor.h>
+
+// Items read() takes at once from an input several workers share
+// More means fewer trips through its lock, but a slow item holds up
+//   the ones taken with it
+#define CSP_CLAIM_ITEMS 4
 
 namespace csp
 {
@@ -31,7 +38,8 @@ class channel
 	using this_pipe = channel<t_in,t_out,t_args...>;
 public:
 	// Wait to write till this is filled
-	std::thread worker;
+	// Ready when the channel has finished running in the background
+	std::future<void> worker;
 
 	// True if work is done in the background
 	bool background;
@@ -42,6 +50,18 @@ public:
 	message_stream<t_in>* csp_input;
 	message_stream<t_out>* csp_output;
 
+	// Woken up when the input gets connected with set_input()
+	// Must stay above arguments, see below
+	event input_set;
+
+	// Taken from a shared input by read() but not handed out yet
+	std::vector<t_in> claimed;
+	size_t claimed_next;
+
+	// Whatever the items this channel wrote point into, like mmap_cat's
+	//   mapping, let go of with the channel
+	std::shared_ptr<const void> keep_alive;
+
 	// The channel that contains the pipeline information
 	channel* master;
 	// This references all of the channels in the pipeline to keep them alive
@@ -56,6 +76,10 @@ public:
 	// The function pointer member to the function that this channel runs
 	void(this_pipe::*start)(t_args...) = 0;
 
+	// Set by coroutine channels, starts the channel without a thread
+	// The future is ready once it's finished, see coro.h
+	std::future<void>(*launcher)(this_pipe*) = 0;
+
 	// Variable length...
 	// Putting this last allows for self-referential pipes to be called
 	//   through a pointer without knowing the size of the member to align
@@ -64,7 +88,7 @@ public:
 	std::tuple<t_args...> arguments;
 
 	channel() : background(false), manage_input(false), manage_output(true),
-			csp_input(NULL), csp_output(NULL), master(NULL)
+			csp_input(NULL), csp_output(NULL), claimed_next(0), master(NULL)
 	{
 		if (!is_nothing<t_out>::value)
 			csp_output = new message_stream<t_out>();
@@ -73,7 +97,7 @@ public:
 	~channel()
 	{
 		if (background)
-			worker.join();
+			worker.wait();
 
 		pipeline.clear();
 
@@ -90,7 +114,9 @@ public:
 		csp_output = src.csp_output;
 		csp_input = src.csp_input;
 		background = src.background;
+		claimed_next = 0;
 		start = src.start;
+		launcher = src.launcher;
 		master = src.master;
 	}
 
@@ -107,20 +133,76 @@ public:
 	{
 		static_assert(!is_nothing<t_in>::value,
 				"Called read in csp pipe without input");
-		spinlock(&csp_input);
+		wait_input();
 
-		return csp_input->read(input);
+		if (!csp_input->always_lock_read)
+			return csp_input->read(input);
+		// Every read of a shared input takes its lock, so take a few
+		//   items each time
+		if (claimed_next == claimed.size())
+		{
+			claimed.resize(CSP_CLAIM_ITEMS);
+			claimed.resize(csp_input->read_batch(claimed.data(), CSP_CLAIM_ITEMS));
+			claimed_next = 0;
+			if (claimed.empty())
+				return false;
+		}
+		input = std::move(claimed[claimed_next++]);
+		return true;
 	}
+	// Reads up to max items into input with a single check of the stream
+	// Blocks until there is at least one item
+	// Returns how many were read, zero when there is no input left
+	size_t read_batch(t_in* input, size_t max)
+	{
+		static_assert(!is_nothing<t_in>::value,
+				"Called read in csp pipe without input");
+		wait_input();
+
+		// Items read() already took from a shared input come first
+		if (claimed_next != claimed.size())
+		{
+			size_t count = std::min(max, claimed.size() - claimed_next);
+			std::move(claimed.begin() + claimed_next,
+					claimed.begin() + claimed_next + count, input);
+			claimed_next += count;
+			return count;
+		}
+		return csp_input->read_batch(input, max);
+	}
+	// How many items a stage should try to read at once
+	// Workers sharing an input take a few at a time, so a slow item
+	//   only holds up the ones taken with it
+	size_t batch_size()
+	{
+		wait_input();
+		if (csp_input->always_lock_read)
+			return std::min(csp_input->chunk.load(), (size_t)CSP_CLAIM_ITEMS);
+		return csp_input->chunk;
+	}
+	// Moves count items out of out and into the output
+	void put_batch(t_out* out, size_t count)
+	{
+		csp_output->write_batch(out, count);
+	}
+
 	// Needed if multiple threads accessing this channel
 	bool safe_read(t_in& input)
 	{
 		static_assert(!is_nothing<t_in>::value,
 				"Called read in csp pipe without input");
-		spinlock(&csp_input);
+		wait_input();
 
 		return csp_input->safe_read(input);
 	}
 
+	// Connects the input of a channel that might already be running
+	void set_input(message_stream<t_in>* input)
+	{
+		__atomic_store_n(&csp_input, input, __ATOMIC_RELEASE);
+		input_set.notify_all();
+	}
+
 	// Only call this if the channel was created through encap()
 	// This will message that this input is complete
 	void close_input()
@@ -142,28 +224,24 @@ private:
 	}
 	/* END DO NOT TOUCH */
 
-	// Called by worker thread only, runs the runner
-	static void begin_background(this_pipe* a)
+public:
+	// encap() connects the input after the channel has already started
+	void wait_input()
 	{
-		a->do_start();
+		input_set.wait([this]{
+			return __atomic_load_n(&csp_input, __ATOMIC_ACQUIRE) != NULL;
+		});
 	}
 
-	template<typename T>
-	void spinlock(message_stream<T>** waiton)
-	{
-		std::mutex barrier;
-		while (*waiton == NULL)
-		{
-			barrier.lock();
-			if (*waiton) {barrier.unlock(); break;}
-			barrier.unlock();
-			pthread_yield();
-		}
-	}
-public:
 	// Starting point to finally do all the work
 	bool do_start()
 	{
+		if (launcher)
+		{
+			launcher(this).wait();
+			return true;
+		}
+
 		// Create a tuple with the this pointer and arguments together
 		// Works with the tuple expander call function easily
 		std::tuple<channel*> head (this);
@@ -171,15 +249,23 @@ public:
 				std::tuple_cat(head, arguments);
 		call(do_start_actually, thisargs);
 
-		// Finished processing input
-		if (!is_nothing<t_out>::value && manage_output)
-			csp_output->done();
+		finish();
 		return true;
 	}
+	// Finished processing input
+	void finish()
+	{
+		// Lanes are only written by this channel so they get finished too
+		if (!is_nothing<t_out>::value && (manage_output || csp_output->parent))
+			csp_output->done();
+	}
 	void start_background()
 	{
 		background = true;
-		worker = std::thread(begin_background, this);
+		if (launcher)
+			worker = launcher(this);
+		else
+			worker = executor::get().run([this]{ do_start(); });
 	}
 };
 
@@ -267,6 +353,118 @@ chan_create(t_args... args)
 	return a;
 }
 
+/* ========================
+ * stored_fn
+ * Keeps a callable in a channel's arguments
+ * Arguments get default constructed and then assigned, which lambdas
+ *   can't do, so the callable is kept behind a pointer instead
+ * Unlike std::function the type of F is kept, so calls get inlined
+ * ========================
+ */
+template <typename F>
+struct stored_fn
+{
+	std::shared_ptr<F> fn;
+
+	stored_fn() {}
+	stored_fn(F f) : fn(std::make_shared<F>(std::move(f))) {}
+};
+
+/* ========================
+ * chan_each
+ * Creates a channel that handles every item by itself with step
+ * step(in, out) fills in out and returns true to put it,
+ *   false to drop the item
+ * Channels made with this can be joined together with fuse()
+ * ========================
+ */
+template <typename t_in, typename t_out, typename F>
+struct each_fn : stored_fn<F>
+{
+	each_fn() {}
+	each_fn(F f) : stored_fn<F>(std::move(f)) {}
+
+	bool operator()(t_in& in, t_out& out) const
+	{
+		return (*this->fn)(in, out);
+	}
+};
+
+template <typename t_in, typename t_out, typename F>
+class each_t : public channel<t_in, t_out, each_fn<t_in,t_out,F>>
+{
+public:
+	void run(each_fn<t_in,t_out,F> step)
+	{
+		// Copied out so the loop doesn't go through the pointer
+		F fn = *step.fn;
+
+		std::vector<t_in> items (this->batch_size());
+		std::vector<t_out> output (items.size());
+		size_t count;
+		while ((count = this->read_batch(items.data(), items.size())))
+		{
+			size_t kept = 0;
+			for (size_t i = 0; i < count; i++)
+				if (fn(items[i], output[kept]))
+					kept++;
+			this->put_batch(output.data(), kept);
+		}
+	}
+};
+template <typename t_in, typename t_out, typename F>
+csp::shared_ptr<channel<t_in, t_out, each_fn<t_in,t_out,F>>>
+	chan_each(F step)
+{
+	return chan_create<t_in, t_out, each_t<t_in,t_out,F>,
+			each_fn<t_in,t_out,F>>(each_fn<t_in,t_out,F>(std::move(step)));
+}/* chan_each */
+
+/* ========================
+ * fuse
+ * Joins channels made with chan_each into one channel
+ * fuse(a(), b(), c()) does the same as a() | b() | c(), but every item
+ *   goes through all of them in one loop on one thread
+ * Use it when each step is cheaper than passing an item between threads
+ * ========================
+ */
+// Holds copies of the steps, so every thread that copies this
+//   gets steps of its own too
+template <typename t_in, typename t_mid, typename t_out, typename F, typename G>
+struct fused_fn
+{
+	F first;
+	G second;
+
+	bool operator()(t_in& in, t_out& out)
+	{
+		t_mid mid;
+		return first(in, mid) && second(mid, out);
+	}
+};
+
+template <typename t_in, typename t_mid, typename t_out, typename F, typename G>
+csp::shared_ptr<channel<t_in, t_out, each_fn<t_in,t_out,
+	fused_fn<t_in,t_mid,t_out,F,G>>>>
+	fuse(csp::shared_ptr<channel<t_in, t_mid, each_fn<t_in,t_mid,F>>>&& first,
+		csp::shared_ptr<channel<t_mid, t_out, each_fn<t_mid,t_out,G>>>&& second)
+{
+	using step = fused_fn<t_in,t_mid,t_out,F,G>;
+	return chan_each<t_in,t_out>(step{
+			*std::get<0>(first->arguments).fn, *std::get<0>(second->arguments).fn});
+}
+template <typename t_in, typename t_mid, typename t_out, typename F, typename G,
+		typename t_next, typename... t_rest>
+auto fuse(csp::shared_ptr<channel<t_in, t_mid, each_fn<t_in,t_mid,F>>>&& first,
+		csp::shared_ptr<channel<t_mid, t_out, each_fn<t_mid,t_out,G>>>&& second,
+		t_next&& next, t_rest&&... rest)
+	-> decltype(fuse(fuse(std::move(first), std::move(second)),
+			std::forward<t_next>(next), std::forward<t_rest>(rest)...))
+{
+	return fuse(fuse(std::move(first), std::move(second)),
+			std::forward<t_next>(next), std::forward<t_rest>(rest)...);
+}/* fuse */
+
 // The pipe-into operator must be >>= because >> gets executed before |
 // This causes statements cat(file) | grab("stuff") >> vectorOfStrings
 //   to error
@@ -306,13 +504,9 @@ csp::channel<tin, tout>
 	// Merge the input/output with result's
 	// Users read this channel from csp_input, write to csp_output
 	// Leftmost is written to, rightmost is read from
-	pipe->pipeline.front()->csp_input = result.csp_output;
+	pipe->pipeline.front()->set_input(result.csp_output);
 	result.csp_input = pipe->csp_output;
 
-	// There exists a race condition when calling put() and close_input()
-	// Must lock when writing and closing
-	result.csp_input->always_lock = true;
-
 	barrier.unlock();
 
 	pipe->start_background();
@@ -338,6 +532,54 @@ csp::shared_ptr<csp::channel<tin, tout, targs...>>
 	return channel;
 }
 
+/* ========================
+ * bounded
+ * Takes in a single channel, limits how many items its output
+ *   can hold before the channel blocks writing
+ * Keeps memory use flat when a fast channel feeds a slow one
+ * Don't use on the last channel of a pipeline ending in >>=,
+ *   its output isn't read until it finishes
+ * ========================
+ */
+template <typename tin, typename tout, typename... targs>
+csp::shared_ptr<csp::channel<tin, tout, targs...>>
+	bounded(size_t capacity,
+			csp::shared_ptr<csp::channel<tin,tout,targs...>>&& channel)
+{
+	channel->csp_output->set_capacity(capacity);
+	return channel;
+}
+
+/* ========================
+ * chunked
+ * Takes in a single channel, sets how many items its output
+ *   collects before waking the reader
+ * Small items want big chunks, big items want small ones
+ * ========================
+ */
+template <typename tin, typename tout, typename... targs>
+csp::shared_ptr<csp::channel<tin, tout, targs...>>
+	chunked(size_t items,
+			csp::shared_ptr<csp::channel<tin,tout,targs...>>&& channel)
+{
+	channel->csp_output->set_chunk(items);
+	return channel;
+}
+
+/* ========================
+ * adaptive_chunk
+ * Takes in a single channel, lets its output pick the chunk size
+ *   from the size of the items and how often the reader waits
+ * ========================
+ */
+template <typename tin, typename tout, typename... targs>
+csp::shared_ptr<csp::channel<tin, tout, targs...>>
+	adaptive_chunk(csp::shared_ptr<csp::channel<tin,tout,targs...>>&& channel)
+{
+	channel->csp_output->adaptive = true;
+	return channel;
+}
+
 } /* namespace csp */
 
 #endif /* CSP_H_ */
@@ -8,6 +8,8 @@
 #ifndef READ_H_
 #define READ_H_
 
+#include <functional>
+
 #include <csp/csplib.h>
 
 namespace csp{
@@ -15,50 +17,34 @@ namespace csp{
 /* ================================================================
  * chan_select
  * Only output input when the overloaded function returns true
+ * Takes any callable, lambdas get inlined into the channel's loop
  * ================================================================
  */
-template <typename t_in>
-class chan_select_t : public csp::channel<
-		t_in, t_in,
-		std::function<bool(t_in&)>>
+template <typename t_in, typename F>
+struct select_fn
 {
-public:
-	using funkname = std::function<bool(t_in&)>;
-	// This is the type we want to be, a csp pipe
-	using thistype = csp::channel<
-		t_in, t_in,
-		funkname>;
+	// Not const, so mutable lambdas work like they did with std::function
+	F a;
 
-	void run(funkname a)
+	bool operator()(t_in& in, t_in& out)
 	{
-		t_in line;
-		while (this->read(line))
-			if(a(line))	this->put(std::move(line));
+		if (!a(in))
+			return false;
+		out = std::move(in);
+		return true;
 	}
 };
 // channel functor
-template <typename t_in>
+template <typename t_in, typename F>
 csp::shared_ptr<csp::channel
 <
 	t_in,
 	t_in,
-	std::function<bool(t_in&)>
+	each_fn<t_in,t_in,select_fn<t_in,F>>
 >>
-	chan_select(
-		std::function<bool(t_in&)>
-					asdf)
+	chan_select(F asdf)
 {
-	using funkname = std::function<bool(t_in&)>;
-	using thistype = csp::channel<
-		t_in, t_in,
-		funkname>;
-	auto result = csp::make_shared<thistype>();
-
-	result->arguments = std::make_tuple(asdf);
-	result->start = (void(thistype::*)(funkname))
-			&chan_select_t<t_in>::run;
-
-	return result;
+	return chan_each<t_in,t_in>(select_fn<t_in,F>{asdf});
 } // chan_select
 
 /* ================================================================
@@ -118,52 +104,31 @@ csp::shared_ptr<csp::channel
  * chan_iter
  * Iterate over a pipe in-line, always output
  * cat(file) | chan_read<...>...
+ * Takes any callable, lambdas get inlined into the channel's loop
  * ================================================================
  */
-template <typename t_in, typename t_out>
-class chan_iter_t : public csp::channel<
-		t_in, t_out,
-		std::function<t_out(t_in&)>>
+template <typename t_in, typename t_out, typename F>
+struct iter_fn
 {
-public:
-	using funkname = std::function<t_out(t_in&)>;
-	// This is the type we want to be, a csp pipe
-	using thistype = csp::channel<
-		t_in, t_out,
-		funkname>;
+	F a;
 
-	void run(funkname a)
+	bool operator()(t_in& in, t_out& out)
 	{
-		t_in line;
-		while (this->read(line))
-			this->put(a(line));
+		out = a(in);
+		return true;
 	}
 };
 // channel functor
-template <typename t_in, typename t_out>
+template <typename t_in, typename t_out, typename F>
 csp::shared_ptr<csp::channel
 <
 	t_in,
 	t_out,
-	std::function<t_out(t_in&)>
+	each_fn<t_in,t_out,iter_fn<t_in,t_out,F>>
 >>
-	chan_iter(
-		std::function<t_out(t_in&)>
-					asdf)
+	chan_iter(F asdf)
 {
-	using funkname = std::function<t_out(t_in&)>;
-	// madotsuki_eating_soup.jpg
-	using thistype = csp::channel<
-		t_in, t_out,
-		funkname>;
-
-	auto result = csp::make_shared<thistype>();
-
-	result->arguments = std::make_tuple(asdf);
-	result->start = (void(thistype::*)(funkname))
-			&chan_iter_t<t_in,t_out>::run;
-
-	return result;
+	return chan_each<t_in,t_out>(iter_fn<t_in,t_out,F>{asdf});
 } // chan_read
 
 
@@ -174,47 +139,45 @@ csp::shared_ptr<csp::channel
  * (can't use thisptr->put() -- thus no output)
  * ================================================================
  */
-template <typename t_in>
+template <typename t_in, typename F>
 class chan_sans_output_read_t : public csp::channel<
 		t_in, csp::nothing,
-		std::function<void(t_in&)>>
+		stored_fn<F>>
 {
 public:
 	// This is the type we want to be, a csp pipe
 	using thistype = csp::channel<
 		t_in, csp::nothing,
-		std::function<void(t_in&)>>;
+		stored_fn<F>>;
 
-	void run(std::function<void(t_in&)> a)
+	void run(stored_fn<F> stored)
 	{
+		F a = *stored.fn;
 		t_in line;
 		while (this->read(line))
 			a(line);
 	}
 };
 // channel functor
-template <typename t_in>
+template <typename t_in, typename F>
 csp::shared_ptr<csp::channel
 <
 	t_in,
 	csp::nothing,
-	std::function<void(t_in&)>
+	stored_fn<F>
 >>
-	chan_read(
-		std::function<void(t_in&)>
-					asdf)
+	chan_read(F asdf)
 {
 	// madotsuki_eating_soup.jpg
-	using funkname = std::function<void(t_in&)>;
 	using thistype = csp::channel<
 		t_in, csp::nothing,
-		funkname>;
+		stored_fn<F>>;
 
 	auto result = csp::make_shared<thistype>();
 
-	result->arguments = std::make_tuple(asdf);
-	result->start = (void (thistype::*)(funkname))
-			&chan_sans_output_read_t<t_in>::run;
+	result->arguments = std::make_tuple(stored_fn<F>(asdf));
+	result->start = (void (thistype::*)(stored_fn<F>))
+			&chan_sans_output_read_t<t_in,F>::run;
 
 	return result;
 } // chan_read
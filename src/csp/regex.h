@@ -0,0 +1,739 @@
+/*
+ * regex.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef REGEX_H_
+#define REGEX_H_
+
+#include <vector>
+#include <string>
+#include <map>
+#include <bitset>
+#include <memory>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+#include <csp/string.h>
+
+namespace csp{
+
+// DFA states a matcher keeps, each is a row of its table
+// Past this the matcher throws them all away and starts over
+#define CSP_REGEX_CACHE 4096
+// Most states a pattern can compile to, x{1000} makes 1000 copies of x
+#define CSP_REGEX_STATES 100000
+
+// Extended regular expression, the kind grep -E takes
+// Knows ( ) | * + ? {m,n} . [ ] [^ ] [:class:] ^ $ \d \w \s \D \W \S
+// Only answers whether a line has a match, not where it is
+// Never changes once compiled, so matchers on many threads can share it
+class regex
+{
+public:
+	// The bytes, then symbols fed before and after the text
+	// ^ and $ are the only things that move on those
+	enum { begin = 256, end = 257, symbols = 258 };
+	typedef std::bitset<symbols> symbol_set;
+
+	struct state
+	{
+		enum kind_t { set, split, match } kind;
+		// Symbols a set state moves on
+		symbol_set on;
+		uint32_t out, out1;
+	};
+
+	// The NFA, starts with a loop that skips any text so matches can start anywhere
+	std::vector<state> states;
+	uint32_t start;
+	// Symbols that every set treats the same share a class,
+	//   the DFA has a column per class
+	uint16_t class_of[symbols];
+	std::vector<uint16_t> representative;
+
+	// Text every match contains, lines without it can be skipped
+	std::string required;
+	// Text every match starts with
+	std::string prefix;
+	// The whole pattern is plain text
+	bool literal_only;
+	bool uses_begin;
+	bool ok;
+
+private:
+	struct node
+	{
+		enum kind_t { set, concat, alt, repeat } kind;
+		symbol_set on;
+		std::vector<int> kids;
+		// max is -1 for no limit
+		int min, max;
+
+		node() : min(1), max(1) {}
+	};
+	// What's known about the text a node matches
+	struct literal
+	{
+		// Always matches exactly text
+		bool full;
+		std::string text, prefix, suffix, required;
+	};
+
+	std::vector<node> nodes;
+	const char* p;
+	const char* stop;
+
+	int add(node n)
+	{
+		nodes.push_back(std::move(n));
+		return nodes.size() - 1;
+	}
+	int add_set(const symbol_set& on)
+	{
+		node n;
+		n.kind = node::set;
+		n.on = on;
+		return add(n);
+	}
+
+	static void named_class(int (*test)(int), bool negate, symbol_set& on)
+	{
+		for (int i = 0; i < 256; i++)
+			if ((test(i) != 0) != negate)
+				on.set(i);
+	}
+	static int is_word(int c)
+	{
+		return isalnum(c) || c == '_';
+	}
+	// Sets the bytes for \c, false if it isn't a class
+	static bool escape_class(char c, symbol_set& on)
+	{
+		switch (c)
+		{
+		case 'd': named_class(isdigit, false, on); return true;
+		case 'D': named_class(isdigit, true, on); return true;
+		case 'w': named_class(is_word, false, on); return true;
+		case 'W': named_class(is_word, true, on); return true;
+		case 's': named_class(isspace, false, on); return true;
+		case 'S': named_class(isspace, true, on); return true;
+		}
+		return false;
+	}
+	static unsigned char escape_char(char c)
+	{
+		switch (c)
+		{
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		}
+		return c;
+	}
+
+	// [ has been read
+	void parse_class(symbol_set& on)
+	{
+		static const struct { const char* name; int (*test)(int); } names[] = {
+			{"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum},
+			{"space", isspace}, {"upper", isupper}, {"lower", islower},
+			{"punct", ispunct}, {"xdigit", isxdigit}, {"blank", isblank},
+			{"cntrl", iscntrl}, {"print", isprint}, {"graph", isgraph}};
+
+		bool negate = p < stop && *p == '^';
+		if (negate)
+			p++;
+		// ] right at the start is just a ]
+		bool first = true;
+		while (true)
+		{
+			if (p == stop)
+			{
+				ok = false;
+				return;
+			}
+			unsigned char c = *p++;
+			if (c == ']' && !first)
+				break;
+			first = false;
+
+			if (c == '[' && p < stop && *p == ':')
+			{
+				// Past the : that opened it, so [[:] isn't read as closed
+				const char* close = (const char*)
+						memmem(p + 1, stop - p - 1, ":]", 2);
+				if (!close)
+				{
+					ok = false;
+					return;
+				}
+				std::string name (p + 1, close);
+				bool known = false;
+				for (const auto& n : names)
+					if (name == n.name)
+					{
+						named_class(n.test, false, on);
+						known = true;
+					}
+				if (!known)
+					ok = false;
+				p = close + 2;
+				continue;
+			}
+			if (c == '\\' && p < stop)
+			{
+				if (escape_class(*p, on))
+				{
+					p++;
+					continue;
+				}
+				c = escape_char(*p++);
+			}
+			if (p + 1 < stop && *p == '-' && p[1] != ']')
+			{
+				unsigned char high = p[1];
+				p += 2;
+				if (high < c)
+					ok = false;
+				for (unsigned i = c; i <= high; i++)
+					on.set(i);
+			}
+			else
+				on.set(c);
+		}
+		if (negate)
+		{
+			for (int i = 0; i < 256; i++)
+				on.flip(i);
+		}
+	}
+
+	int parse_atom()
+	{
+		char c = *p++;
+		symbol_set on;
+		switch (c)
+		{
+		case '(':
+		{
+			int inner = parse_alt();
+			if (p == stop || *p != ')')
+				ok = false;
+			else
+				p++;
+			return inner;
+		}
+		case '[':
+			parse_class(on);
+			break;
+		case '.':
+			for (int i = 0; i < 256; i++)
+				on.set(i);
+			break;
+		case '^':
+			on.set(begin);
+			break;
+		case '$':
+			on.set(end);
+			break;
+		case '\\':
+			if (p == stop)
+				ok = false;
+			else if (!escape_class(*p, on))
+				on.set(escape_char(*p));
+			p++;
+			break;
+		case '*':
+		case '+':
+		case '?':
+			// Nothing to repeat
+			ok = false;
+			break;
+		default:
+			on.set((unsigned char)c);
+		}
+		return add_set(on);
+	}
+
+	static bool parse_number(const char*& q, const char* stop, int& result)
+	{
+		if (q == stop || !isdigit(*q))
+			return false;
+		result = 0;
+		while (q < stop && isdigit(*q) && result <= 1000)
+			result = result * 10 + (*q++ - '0');
+		return true;
+	}
+	// {m}, {m,} or {m,n}, a { that isn't one of those is just a {
+	bool parse_bounds(int& min, int& max)
+	{
+		const char* q = p + 1;
+		if (!parse_number(q, stop, min))
+			return false;
+		max = min;
+		if (q < stop && *q == ',')
+		{
+			q++;
+			if (!parse_number(q, stop, max))
+				max = -1;
+		}
+		if (q == stop || *q != '}')
+			return false;
+		if (min > 1000 || max > 1000 || (max != -1 && max < min))
+			ok = false;
+		p = q + 1;
+		return true;
+	}
+
+	int parse_repeat()
+	{
+		int atom = parse_atom();
+		while (p < stop)
+		{
+			int min, max;
+			if (*p == '*')
+			{
+				min = 0;
+				max = -1;
+				p++;
+			}
+			else if (*p == '+')
+			{
+				min = 1;
+				max = -1;
+				p++;
+			}
+			else if (*p == '?')
+			{
+				min = 0;
+				max = 1;
+				p++;
+			}
+			else if (*p != '{' || !parse_bounds(min, max))
+				break;
+
+			node n;
+			n.kind = node::repeat;
+			n.kids.push_back(atom);
+			n.min = min;
+			n.max = max;
+			atom = add(n);
+		}
+		return atom;
+	}
+
+	int parse_concat()
+	{
+		node n;
+		n.kind = node::concat;
+		while (p < stop && *p != '|' && *p != ')')
+			n.kids.push_back(parse_repeat());
+		if (n.kids.size() == 1)
+			return n.kids[0];
+		return add(n);
+	}
+
+	int parse_alt()
+	{
+		node n;
+		n.kind = node::alt;
+		n.kids.push_back(parse_concat());
+		while (p < stop && *p == '|')
+		{
+			p++;
+			n.kids.push_back(parse_concat());
+		}
+		if (n.kids.size() == 1)
+			return n.kids[0];
+		return add(n);
+	}
+
+	literal analyze(int index) const
+	{
+		const node& n = nodes[index];
+		literal result;
+		result.full = false;
+		switch (n.kind)
+		{
+		case node::set:
+			if (n.on.count() == 1 && !n.on[begin] && !n.on[end])
+			{
+				for (int i = 0; i < 256; i++)
+					if (n.on[i])
+						result.text = std::string(1, (char)i);
+				result.full = true;
+			}
+			// Anchors match no text at all
+			else if ((n.on[begin] || n.on[end]) && n.on.count() == 1)
+				result.full = true;
+			break;
+		case node::concat:
+		{
+			result.full = true;
+			// Text matched by the full kids in a row
+			std::string run;
+			bool leading = true;
+			auto better = [&](const std::string& a)
+			{
+				if (a.size() > result.required.size())
+					result.required = a;
+			};
+			for (int kid : n.kids)
+			{
+				literal k = analyze(kid);
+				if (k.full)
+				{
+					run += k.text;
+					continue;
+				}
+				if (leading)
+					result.prefix = run + k.prefix;
+				leading = false;
+				result.full = false;
+				better(run + k.prefix);
+				better(k.required);
+				run = k.suffix;
+			}
+			better(run);
+			if (result.full)
+				result.text = result.prefix = run;
+			result.suffix = run;
+			return result;
+		}
+		case node::alt:
+			break;
+		case node::repeat:
+		{
+			if (n.min == 0)
+				break;
+			literal k = analyze(n.kids[0]);
+			if (n.min == 1 && n.max == 1)
+				return k;
+			result.prefix = k.prefix;
+			result.suffix = k.suffix;
+			result.required = k.required;
+			if (k.full)
+				result.prefix = result.suffix = result.required = k.text;
+			return result;
+		}
+		}
+		if (result.full)
+			result.prefix = result.suffix = result.required = result.text;
+		return result;
+	}
+
+	uint32_t add_state(state::kind_t kind, uint32_t out, uint32_t out1)
+	{
+		if (states.size() >= CSP_REGEX_STATES)
+			ok = false;
+		state s;
+		s.kind = kind;
+		s.out = out;
+		s.out1 = out1;
+		states.push_back(s);
+		return states.size() - 1;
+	}
+	// Builds the NFA back to front, returns the first state of node
+	//   that goes on to next
+	uint32_t compile(int index, uint32_t next)
+	{
+		if (!ok)
+			return next;
+		const node& n = nodes[index];
+		switch (n.kind)
+		{
+		case node::set:
+		{
+			uint32_t s = add_state(state::set, next, 0);
+			states[s].on = n.on;
+			return s;
+		}
+		case node::concat:
+			for (size_t i = n.kids.size(); i--;)
+				next = compile(n.kids[i], next);
+			return next;
+		case node::alt:
+		{
+			uint32_t result = compile(n.kids.back(), next);
+			for (size_t i = n.kids.size() - 1; i--;)
+				result = add_state(state::split, compile(n.kids[i], next), result);
+			return result;
+		}
+		case node::repeat:
+		{
+			uint32_t result = next;
+			if (n.max == -1)
+			{
+				uint32_t loop = add_state(state::split, 0, next);
+				uint32_t body = compile(n.kids[0], loop);
+				states[loop].out = body;
+				result = loop;
+			}
+			else
+				for (int i = n.min; i < n.max; i++)
+					result = add_state(state::split,
+							compile(n.kids[0], result), next);
+			for (int i = 0; i < n.min; i++)
+				result = compile(n.kids[0], result);
+			return result;
+		}
+		}
+		return next;
+	}
+
+	void make_classes()
+	{
+		// Split the classes by every set in turn
+		memset(class_of, 0, sizeof(class_of));
+		uint16_t count = 1;
+		for (const state& s : states)
+		{
+			if (s.kind != state::set)
+				continue;
+			std::map<std::pair<uint16_t,bool>, uint16_t> split;
+			uint16_t next = 0;
+			for (int i = 0; i < symbols; i++)
+			{
+				auto key = std::make_pair(class_of[i], (bool)s.on[i]);
+				auto found = split.find(key);
+				if (found == split.end())
+					found = split.insert(std::make_pair(key, next++)).first;
+				class_of[i] = found->second;
+			}
+			count = next;
+		}
+		representative.assign(count, 0);
+		for (int i = symbols; i--;)
+			representative[class_of[i]] = i;
+	}
+public:
+	regex(const char* pattern) : regex(pattern, strlen(pattern)) {}
+	regex(const char* pattern, size_t size) : ok(true)
+	{
+		p = pattern;
+		stop = pattern + size;
+		int root = parse_alt();
+		// Only a stray ) stops parsing early
+		if (p != stop)
+			ok = false;
+
+		uses_begin = false;
+		bool uses_end = false;
+		for (const node& n : nodes)
+			if (n.kind == node::set)
+			{
+				uses_begin |= n.on[begin];
+				uses_end |= n.on[end];
+			}
+
+		literal info = analyze(root);
+		required = info.required;
+		prefix = info.prefix;
+		literal_only = info.full && !uses_begin && !uses_end;
+
+		// Anything, as many times as it takes, then the pattern
+		uint32_t match = add_state(state::match, 0, 0);
+		uint32_t body = compile(root, match);
+		uint32_t loop = add_state(state::split, 0, body);
+		uint32_t any = add_state(state::set, loop, 0);
+		states[any].on.set();
+		states[loop].out = any;
+		start = loop;
+
+		nodes.clear();
+		make_classes();
+	}
+};
+
+// Runs a regex as a DFA that's built as the text needs it
+// Each DFA state is worked out from the NFA the first time it's reached,
+//   after that every byte is one lookup
+// Not thread safe, but copies start with a cache of their own,
+//   so give each thread a copy
+class regex_matcher
+{
+	std::shared_ptr<const regex> re;
+	size_t classes;
+	// NFA states in each DFA state
+	std::vector<std::vector<uint32_t>> sets;
+	std::map<std::vector<uint32_t>, uint32_t> ids;
+	// Next DFA state is moves[state * classes + class], -1 until worked out
+	std::vector<int32_t> moves;
+	std::vector<char> accepts;
+	int32_t start;
+	// Bumped when the cache is emptied
+	size_t generation;
+
+	// Scratch for closures, a state is visited if its mark is mark
+	std::vector<uint32_t> marks;
+	uint32_t mark;
+	std::vector<uint32_t> stack;
+
+	void reset()
+	{
+		sets.clear();
+		ids.clear();
+		moves.clear();
+		accepts.clear();
+		start = -1;
+		generation++;
+	}
+
+	// Adds s and everything it reaches without reading to result
+	// When moving on ^ or $, anchor is that symbol and any more of the
+	//   same anchor are passed through too, so ^^ matches like ^ does
+	void closure(uint32_t s, std::vector<uint32_t>& result, unsigned anchor = 0)
+	{
+		stack.push_back(s);
+		while (!stack.empty())
+		{
+			uint32_t a = stack.back();
+			stack.pop_back();
+			if (marks[a] == mark)
+				continue;
+			marks[a] = mark;
+			const regex::state& st = re->states[a];
+			if (st.kind == regex::state::split)
+			{
+				stack.push_back(st.out1);
+				stack.push_back(st.out);
+			}
+			else
+			{
+				result.push_back(a);
+				if (anchor && st.kind == regex::state::set &&
+						st.on[anchor] && st.on.count() == 1)
+					stack.push_back(st.out);
+			}
+		}
+	}
+	void next_mark()
+	{
+		if (!++mark)
+		{
+			std::fill(marks.begin(), marks.end(), 0);
+			mark = 1;
+		}
+	}
+
+	uint32_t add(std::vector<uint32_t>& set)
+	{
+		std::sort(set.begin(), set.end());
+		auto found = ids.find(set);
+		if (found != ids.end())
+			return found->second;
+
+		// Full, start over with just this one
+		if (sets.size() >= CSP_REGEX_CACHE)
+			reset();
+		uint32_t id = sets.size();
+		bool accept = false;
+		for (uint32_t a : set)
+			accept |= re->states[a].kind == regex::state::match;
+		ids.insert(std::make_pair(set, id));
+		sets.push_back(set);
+		moves.resize(moves.size() + classes, -1);
+		accepts.push_back(accept);
+		return id;
+	}
+
+	uint32_t get_start()
+	{
+		if (start < 0)
+		{
+			std::vector<uint32_t> set;
+			next_mark();
+			closure(re->start, set);
+			start = add(set);
+		}
+		return start;
+	}
+
+	// Works out the move from a DFA state on a class
+	uint32_t step(uint32_t from, unsigned cls)
+	{
+		std::vector<uint32_t> set;
+		next_mark();
+		unsigned symbol = re->representative[cls];
+		unsigned anchor = symbol >= regex::begin ? symbol : 0;
+		for (uint32_t a : sets[from])
+		{
+			const regex::state& st = re->states[a];
+			if (st.kind == regex::state::set && st.on[symbol])
+				closure(st.out, set, anchor);
+		}
+		size_t before = generation;
+		uint32_t to = add(set);
+		// If the cache was emptied, from is gone
+		if (generation == before)
+			moves[from * classes + cls] = to;
+		return to;
+	}
+	uint32_t move(uint32_t from, unsigned cls)
+	{
+		int32_t to = moves[from * classes + cls];
+		return to < 0 ? step(from, cls) : to;
+	}
+public:
+	regex_matcher() : classes(0), start(-1), generation(0), mark(0) {}
+	regex_matcher(std::shared_ptr<const regex> re) :
+		re(re), classes(re ? re->representative.size() : 0), start(-1),
+		generation(0), marks(re ? re->states.size() : 0, 0), mark(0) {}
+	regex_matcher(const regex_matcher& a) : regex_matcher(a.re) {}
+	regex_matcher& operator=(const regex_matcher& a)
+	{
+		*this = regex_matcher(a.re);
+		return *this;
+	}
+	regex_matcher(regex_matcher&&) = default;
+	regex_matcher& operator=(regex_matcher&&) = default;
+
+	bool ok() const
+	{
+		return re && re->ok;
+	}
+
+	// True if data has a match anywhere in it
+	bool search(const char* data, size_t size)
+	{
+		const regex& r = *re;
+		if (!r.ok)
+			return false;
+		if (!r.required.empty() &&
+				!find_bytes(data, size, r.required.data(), r.required.size()))
+			return false;
+		if (r.literal_only)
+			return true;
+
+		// Matches can only start where the prefix is, so skip up to there
+		size_t i = 0;
+		if (!r.uses_begin && !r.prefix.empty())
+		{
+			const char* at = find_bytes(data, size, r.prefix.data(), r.prefix.size());
+			if (!at)
+				return false;
+			i = at - data;
+		}
+
+		uint32_t s = get_start();
+		if (i == 0)
+			s = move(s, r.class_of[regex::begin]);
+		if (accepts[s])
+			return true;
+		for (; i < size; i++)
+		{
+			s = move(s, r.class_of[(unsigned char)data[i]]);
+			if (accepts[s])
+				return true;
+		}
+		return accepts[move(s, r.class_of[regex::end])];
+	}
+};
+
+}
+
+#endif /* REGEX_H_ */
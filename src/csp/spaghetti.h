@@ -1,5 +1,17 @@
+// Default number of items in a chunk
 // Testing shows that for wordstack, this is the optimal value
+// Channels can pick their own with chunked() or adaptive_chunk()
+#ifndef CSP_CACHE_DEFAULT
 #define CSP_CACHE_DEFAULT 64
+#endif
+
+// adaptive_chunk() aims for chunks this many bytes big
+#ifndef CSP_CHUNK_BYTES
+#define CSP_CHUNK_BYTES 4096
+#endif
+// Smallest and largest chunks adaptive_chunk() will pick
+#define CSP_CHUNK_MIN 8
+#define CSP_CHUNK_MAX 4096
 
 #define CSP_DECL_CONTAINER(fn_name, input, output, ...)\
 	class _##fn_name##_t_ : public\
@@ -10,99 +10,674 @@
 
 #include <iterator>
 #include <cstring>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 // Extremely dumb string, no copy-on-write like GNU standard strings
 // Not trying to be standards-compliant here
 
 namespace csp{
-class string : public std::vector<char>
+
+/* ================================
+ * Substring search
+ * Checks 16 or 32 places at once for the first and last byte of the
+ *   needle and only compares the rest where both match
+ * Needles that keep almost matching could make that quadratic, so once
+ *   comparing costs more than scanning, the rest of the haystack is
+ *   searched with memmem, which is linear
+ * ================================
+ */
+// Comparing may cost this many bytes per byte scanned before giving up
+#define CSP_FIND_VERIFY 4
+// Longest pattern whose KMP table in find_nocase_linear is on the stack
+#define CSP_KMP_STACK 64
+
+#if defined(__x86_64__)
+inline const char* find_sse2(const char* a, size_t alen, const char* b, size_t blen)
 {
+	const __m128i first = _mm_set1_epi8(b[0]);
+	const __m128i last = _mm_set1_epi8(b[blen - 1]);
+	size_t compared = 0;
+	size_t i = 0;
+	for (; i + blen - 1 + 16 <= alen; i += 16)
+	{
+		__m128i f = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i l = _mm_loadu_si128((const __m128i*)(a + i + blen - 1));
+		unsigned mask = _mm_movemask_epi8(
+				_mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+		while (mask)
+		{
+			size_t at = i + __builtin_ctz(mask);
+			if (!memcmp(a + at + 1, b + 1, blen - 2))
+				return a + at;
+			compared += blen;
+			mask &= mask - 1;
+		}
+		if (compared > CSP_FIND_VERIFY * (i + 16))
+		{
+			i += 16;
+			break;
+		}
+	}
+	return (const char*)memmem(a + i, alen - i, b, blen);
+}
+__attribute__((target("avx2")))
+inline const char* find_avx2(const char* a, size_t alen, const char* b, size_t blen)
+{
+	const __m256i first = _mm256_set1_epi8(b[0]);
+	const __m256i last = _mm256_set1_epi8(b[blen - 1]);
+	size_t compared = 0;
+	size_t i = 0;
+	for (; i + blen - 1 + 32 <= alen; i += 32)
+	{
+		__m256i f = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i l = _mm256_loadu_si256((const __m256i*)(a + i + blen - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_cmpeq_epi8(f, first), _mm256_cmpeq_epi8(l, last)));
+		while (mask)
+		{
+			size_t at = i + __builtin_ctz(mask);
+			if (!memcmp(a + at + 1, b + 1, blen - 2))
+				return a + at;
+			compared += blen;
+			mask &= mask - 1;
+		}
+		if (compared > CSP_FIND_VERIFY * (i + 32))
+		{
+			i += 32;
+			break;
+		}
+	}
+	// Whatever is left is shorter than a vector, or not worth it
+	return find_sse2(a + i, alen - i, b, blen);
+}
+#endif
+
+#if defined(__x86_64__)
+inline bool has_avx2()
+{
+	static const bool result = __builtin_cpu_supports("avx2");
+	return result;
+}
+#endif
+
+// Returns where b first shows up in a, NULL if it doesn't
+inline const char* find_bytes(const char* a, size_t alen, const char* b, size_t blen)
+{
+	if (blen == 0)
+		return a;
+	if (blen > alen)
+		return NULL;
+	if (blen == 1)
+		return (const char*)memchr(a, b[0], alen);
+#if defined(__x86_64__)
+	if (has_avx2())
+		return find_avx2(a, alen, b, blen);
+	return find_sse2(a, alen, b, blen);
+#else
+	return (const char*)memmem(a, alen, b, blen);
+#endif
+}
+/* ================================
+ * Case folding
+ * ASCII letters are lowered 16 or 32 bytes at a time, with a compare
+ *   for the range and an add, no call or table per byte
+ * lower_utf8 does the same over runs of ASCII and decodes the rest,
+ *   lowering the Latin, Greek and Cyrillic capitals whose lower case
+ *   is the same length, so it can still work in place
+ * ================================
+ */
+inline char lower_char(char c)
+{
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+#if defined(__x86_64__)
+inline __m128i lower_sse2(__m128i x)
+{
+	// Bytes past 0x7f are negative, so they're never in range
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+			_mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+	return _mm_add_epi8(x, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+__attribute__((target("avx2")))
+inline size_t lower_ascii_avx2(char* data, size_t size)
+{
+	const __m256i before_a = _mm256_set1_epi8('A' - 1);
+	const __m256i after_z = _mm256_set1_epi8('Z' + 1);
+	const __m256i shift = _mm256_set1_epi8('a' - 'A');
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+		__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, before_a),
+				_mm256_cmpgt_epi8(after_z, x));
+		x = _mm256_add_epi8(x, _mm256_and_si256(upper, shift));
+		_mm256_storeu_si256((__m256i*)(data + i), x);
+	}
+	return i;
+}
+#endif
+
+// Lowers ASCII letters in place, every other byte is left alone
+inline void lower_ascii(char* data, size_t size)
+{
+	size_t i = 0;
+#if defined(__x86_64__)
+	if (has_avx2())
+		i = lower_ascii_avx2(data, size);
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+		_mm_storeu_si128((__m128i*)(data + i), lower_sse2(x));
+	}
+#endif
+	for (; i < size; i++)
+		data[i] = lower_char(data[i]);
+}
+
+// Lower case of a code point that takes two bytes in UTF-8,
+//   only where the lower case takes two bytes as well
+inline unsigned lower_code_point(unsigned c)
+{
+	// Latin-1, except the multiplication sign
+	if (c >= 0xc0 && c <= 0xde && c != 0xd7)
+		return c + 0x20;
+	// Latin Extended-A, capitals and small letters take turns
+	if (c >= 0x100 && c <= 0x17f)
+	{
+		if (c == 0x178)
+			return 0xff;
+		if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e))
+			return c & 1 ? c + 1 : c;
+		if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149 || c == 0x17f)
+			return c;
+		return c & 1 ? c : c + 1;
+	}
+	// Greek
+	if (c >= 0x391 && c <= 0x3a9 && c != 0x3a2)
+		return c + 0x20;
+	// Cyrillic
+	if (c >= 0x410 && c <= 0x42f)
+		return c + 0x20;
+	if (c >= 0x400 && c <= 0x40f)
+		return c + 0x50;
+	return c;
+}
+
+// Lowers UTF-8 text in place
+// Bytes that aren't valid UTF-8 are left alone
+inline void lower_utf8(char* data, size_t size)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+#if defined(__x86_64__)
+		// Runs of ASCII go a vector at a time
+		while (i + 16 <= size)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+			if (_mm_movemask_epi8(x))
+				break;
+			_mm_storeu_si128((__m128i*)(data + i), lower_sse2(x));
+			i += 16;
+		}
+		if (i == size)
+			break;
+#endif
+		unsigned char c = data[i];
+		if (c < 0x80)
+		{
+			data[i++] = lower_char(c);
+			continue;
+		}
+		// Every code point with a lower case here takes two bytes,
+		//   longer sequences are skipped a byte at a time
+		unsigned char next = i + 1 < size ? data[i + 1] : 0;
+		if ((c & 0xe0) == 0xc0 && (next & 0xc0) == 0x80)
+		{
+			unsigned lower = lower_code_point(((c & 0x1f) << 6) | (next & 0x3f));
+			data[i] = 0xc0 | (lower >> 6);
+			data[i + 1] = 0x80 | (lower & 0x3f);
+			i += 2;
+		}
+		else
+			i++;
+	}
+}
+
+// True if a and b are the same ignoring ASCII case, b is lower case
+inline bool equal_nocase(const char* a, const char* b, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		if (lower_char(a[i]) != b[i])
+			return false;
+	return true;
+}
+
+// Knuth-Morris-Pratt over a lowered as it goes, b lower case already
+// Linear however often b nearly matches, for when checking each
+//   candidate in find_nocase would be quadratic
+inline const char* find_nocase_linear(const char* a, size_t alen,
+		const char* b, size_t blen)
+{
+	if (blen == 0)
+		return a;
+	// How much of b still matches after a mismatch just past b[i]
+	// Only long patterns allocate for it
+	size_t table[CSP_KMP_STACK];
+	std::vector<size_t> large;
+	size_t* fallback = table;
+	if (blen > CSP_KMP_STACK)
+	{
+		large.resize(blen);
+		fallback = large.data();
+	}
+	fallback[0] = 0;
+	for (size_t i = 1, k = 0; i < blen; i++)
+	{
+		while (k && b[i] != b[k])
+			k = fallback[k - 1];
+		if (b[i] == b[k])
+			k++;
+		fallback[i] = k;
+	}
+	for (size_t i = 0, k = 0; i < alen; i++)
+	{
+		char c = lower_char(a[i]);
+		while (k && c != b[k])
+			k = fallback[k - 1];
+		if (c == b[k] && ++k == blen)
+			return a + i + 1 - blen;
+	}
+	return NULL;
+}
+
+// Like find_bytes, but ignoring ASCII case
+// b has to be lower case already
+inline const char* find_nocase(const char* a, size_t alen, const char* b, size_t blen)
+{
+	if (blen == 0)
+		return a;
+	if (blen > alen)
+		return NULL;
+	size_t i = 0;
+#if defined(__x86_64__)
+	// Same filter as find_sse2, on a lowered copy of each vector
+	const __m128i first = _mm_set1_epi8(b[0]);
+	const __m128i last = _mm_set1_epi8(b[blen - 1]);
+	size_t compared = 0;
+	for (; i + blen - 1 + 16 <= alen; i += 16)
+	{
+		__m128i f = lower_sse2(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m128i l = lower_sse2(_mm_loadu_si128((const __m128i*)(a + i + blen - 1)));
+		unsigned mask = _mm_movemask_epi8(
+				_mm_and_si128(_mm_cmpeq_epi8(f, first), _mm_cmpeq_epi8(l, last)));
+		while (mask)
+		{
+			size_t at = i + __builtin_ctz(mask);
+			if (blen <= 2 || equal_nocase(a + at + 1, b + 1, blen - 2))
+				return a + at;
+			compared += blen;
+			mask &= mask - 1;
+		}
+		if (compared > CSP_FIND_VERIFY * (i + 16))
+			return find_nocase_linear(a + i + 16, alen - i - 16, b, blen);
+	}
+	// Fewer than 16 places are left to check
+	for (; i + blen <= alen; i++)
+		if (equal_nocase(a + i, b, blen))
+			return a + i;
+	return NULL;
+#else
+	return find_nocase_linear(a, alen, b, blen);
+#endif
+}
+
+/* ================================
+ * string
+ * A line of text
+ * Lines up to CSP_STRING_INLINE bytes are kept in the string itself,
+ *   only longer ones get a buffer from Alloc
+ * Bytes compare unsigned, like memcmp and sort in the C locale
+ * ================================
+ */
+// Bytes kept without allocating, makes a string 64 bytes, one cache line
+#define CSP_STRING_INLINE 56
+
+template <typename Alloc = std::allocator<char>>
+class basic_string : private Alloc
+{
+	typedef std::allocator_traits<Alloc> traits;
+	// Set in used when the bytes are on the heap
+	static const size_t on_heap = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+	size_t used;
+	union
+	{
+		struct
+		{
+			char* bytes;
+			size_t capacity;
+		} heap;
+		char local[CSP_STRING_INLINE];
+	};
+
+	bool is_heap() const
+	{
+		return used & on_heap;
+	}
+	Alloc& allocator()
+	{
+		return *this;
+	}
+	void release()
+	{
+		if (is_heap())
+			traits::deallocate(allocator(), heap.bytes, heap.capacity);
+	}
+	void set_size(size_t size)
+	{
+		used = size | (used & on_heap);
+	}
+	// Moves the bytes to a buffer of at least capacity bytes
+	void grow(size_t capacity)
+	{
+		capacity = std::max(capacity, this->capacity() * 2);
+		char* bytes = traits::allocate(allocator(), capacity);
+		size_t size = this->size();
+		memcpy(bytes, data(), size);
+		release();
+		heap.bytes = bytes;
+		heap.capacity = capacity;
+		used = size | on_heap;
+	}
+	// Empty, with the heap fields set so copying the union reads nothing unset
+	void make_empty()
+	{
+		used = 0;
+		heap.bytes = NULL;
+		heap.capacity = 0;
+	}
+	// Takes a's bytes, this must not own any
+	void take(basic_string& a)
+	{
+		used = a.used;
+		memcpy(local, a.local, sizeof(local));
+		a.used = 0;
+	}
 public:
+	typedef char value_type;
+	typedef char& reference;
+	typedef const char& const_reference;
+	typedef char* iterator;
+	typedef const char* const_iterator;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef Alloc allocator_type;
 	enum : size_t { npos = std::string::npos };
-	string(){}
-	string(const char* a)
+
+	basic_string()
+	{
+		make_empty();
+	}
+	explicit basic_string(const Alloc& alloc) : Alloc(alloc)
+	{
+		make_empty();
+	}
+	basic_string(const char* a)
 	{
+		make_empty();
 		assign(a);
 	}
-	string(const char* a, size_t s)
+	basic_string(const char* a, size_t s)
 	{
+		make_empty();
 		assign(a, s);
 	}
-	string(const std::string& a)
+	basic_string(const std::string& a)
 	{
+		make_empty();
 		assign(a);
 	}
-	string& operator +=(const string& rh)
+	basic_string(const basic_string& a) :
+		Alloc(traits::select_on_container_copy_construction(a))
 	{
-		return append(rh);
+		make_empty();
+		assign(a.data(), a.size());
 	}
-	string& operator +=(const std::string& rh)
+	basic_string(basic_string&& a) noexcept : Alloc(std::move(a.allocator()))
 	{
-		return append(rh);
+		take(a);
 	}
-	string& operator +=(char rh)
+	~basic_string()
 	{
-		return append(rh);
+		release();
 	}
-	string& append(const string& rh)
+
+	basic_string& operator =(const basic_string& a)
 	{
-		for (auto& b : rh)
-			this->push_back(b);
+		if (this != &a)
+			assign(a.data(), a.size());
 		return *this;
 	}
-	string& append(const std::string& rh)
+	basic_string& operator =(basic_string&& a) noexcept
 	{
-		this->reserve(this->size() + rh.size());
-		memcpy(this->data() + this->size(), rh.c_str(), rh.size());
-		this->_M_impl._M_finish += rh.size();
+		if (this == &a)
+			return *this;
+		// A buffer can only change hands if the allocators can free each other's
+		if (!traits::propagate_on_container_move_assignment::value &&
+				!(allocator() == a.allocator()))
+		{
+			assign(a.data(), a.size());
+			a.clear();
+			return *this;
+		}
+		release();
+		if (traits::propagate_on_container_move_assignment::value)
+			allocator() = std::move(a.allocator());
+		take(a);
 		return *this;
 	}
-	string& append(const char* a)
+
+	allocator_type get_allocator() const
 	{
-		while (*a)
+		return *this;
+	}
+
+	size_t size() const
+	{
+		return used & ~on_heap;
+	}
+	size_t length() const
+	{
+		return size();
+	}
+	bool empty() const
+	{
+		return size() == 0;
+	}
+	size_t capacity() const
+	{
+		return is_heap() ? heap.capacity : CSP_STRING_INLINE;
+	}
+	char* data()
+	{
+		return is_heap() ? heap.bytes : local;
+	}
+	const char* data() const
+	{
+		return is_heap() ? heap.bytes : local;
+	}
+	char* begin()
+	{
+		return data();
+	}
+	char* end()
+	{
+		return data() + size();
+	}
+	const char* begin() const
+	{
+		return data();
+	}
+	const char* end() const
+	{
+		return data() + size();
+	}
+	char& operator [](size_t i)
+	{
+		return data()[i];
+	}
+	const char& operator [](size_t i) const
+	{
+		return data()[i];
+	}
+	char& at(size_t i)
+	{
+		if (i >= size())
+			throw std::out_of_range("csp::string::at");
+		return data()[i];
+	}
+	const char& at(size_t i) const
+	{
+		if (i >= size())
+			throw std::out_of_range("csp::string::at");
+		return data()[i];
+	}
+	char& front()
+	{
+		return data()[0];
+	}
+	char& back()
+	{
+		return data()[size() - 1];
+	}
+
+	void reserve(size_t capacity)
+	{
+		if (capacity > this->capacity())
+			grow(capacity);
+	}
+	// Keeps the buffer, so the string can be filled again without allocating
+	void clear()
+	{
+		set_size(0);
+	}
+	void resize(size_t size, char fill = '\0')
+	{
+		size_t old = this->size();
+		reserve(size);
+		if (size > old)
+			memset(data() + old, fill, size - old);
+		set_size(size);
+	}
+	void push_back(char a)
+	{
+		size_t size = this->size();
+		if (size == capacity())
+			grow(size + 1);
+		data()[size] = a;
+		set_size(size + 1);
+	}
+	void pop_back()
+	{
+		set_size(size() - 1);
+	}
+	void swap(basic_string& a)
+	{
+		basic_string b (std::move(a));
+		a = std::move(*this);
+		*this = std::move(b);
+	}
+
+	void assign(const char* a, size_t size)
+	{
+		if (size > capacity())
+		{
+			// a might be in the old buffer, so copy before letting it go
+			char* bytes = traits::allocate(allocator(), size);
+			memcpy(bytes, a, size);
+			release();
+			heap.bytes = bytes;
+			heap.capacity = size;
+			used = size | on_heap;
+			return;
+		}
+		memmove(data(), a, size);
+		set_size(size);
+	}
+	void assign(const char* a)
+	{
+		assign(a, strlen(a));
+	}
+	void assign(const std::string& a)
+	{
+		assign(a.data(), a.size());
+	}
+
+	basic_string& append(const char* a, size_t size)
+	{
+		size_t old = this->size();
+		if (old + size > capacity())
 		{
-			push_back(*a);
-			a++;
+			// a might be in the old buffer
+			const char* start = data();
+			bool inside = a >= start && a < start + old;
+			grow(old + size);
+			if (inside)
+				a = data() + (a - start);
 		}
+		memcpy(data() + old, a, size);
+		set_size(old + size);
 		return *this;
 	}
-	string& append(char a)
+	basic_string& append(const basic_string& rh)
+	{
+		return append(rh.data(), rh.size());
+	}
+	basic_string& append(const std::string& rh)
+	{
+		return append(rh.data(), rh.size());
+	}
+	basic_string& append(const char* a)
+	{
+		return append(a, strlen(a));
+	}
+	basic_string& append(char a)
 	{
 		push_back(a);
 		return *this;
 	}
-	size_t length() const
+	basic_string& operator +=(const basic_string& rh)
 	{
-		return this->size();
+		return append(rh);
 	}
-	static const char* strstr(const char* a, int alen, const char* b, int blen)
+	basic_string& operator +=(const std::string& rh)
 	{
-		int ia = 0, ib = 0;
-		if (blen == 0) return a;
-		for (; ia < alen; ia++)
-		{
-			// Search for single-character match
-			if (a[ia] != b[ib])
-				continue;
-
-			int nia = ia;
-			// Compare the rest
-			while (true)
-			{
-				if (ib == blen)
-					return &a[nia];
-
-				if (a[nia++] != b[ib++])
-					break;
-			}
-			ib = 0;
-		}
-		return 0;
+		return append(rh);
+	}
+	basic_string& operator +=(const char* rh)
+	{
+		return append(rh);
+	}
+	basic_string& operator +=(char rh)
+	{
+		return append(rh);
 	}
-	size_t find(const char* str, int len) const
+
+	size_t find(const char* str, size_t len) const
 	{
-		const char* location = csp::string::strstr(
-				this->data(), this->size(), str, len);
+		const char* location = find_bytes(data(), size(), str, len);
 		if (!location) return npos;
 		return location - data();
 	}
@@ -114,92 +689,114 @@ public:
 	{
 		return find(str.data(), str.length());
 	}
-	size_t find(const string& str) const
+	size_t find(const basic_string& str) const
 	{
 		return find(str.data(), str.length());
 	}
 
-	string substr(size_t pos = 0, size_t len = npos) const
+	basic_string substr(size_t pos = 0, size_t len = npos) const
 	{
-		string a;
 		size_t siz = size();
-		for (size_t i = pos; i < siz && i < len; i++)
-			a.push_back(this->at(i));
-		return a;
-	}
-	int compare(const std::string& str) const
-	{
-		return std_string().compare(str);
-	}
-	int compare(const string& str) const
-	{
-		return compare(str.std_string());
+		if (pos > siz)
+			pos = siz;
+		return basic_string(data() + pos, std::min(len, siz - pos));
 	}
-	int compare(const char* str) const
+	int compare(const char* str, size_t len) const
 	{
-		std::string a (str);
-		return compare(a);
-	}
-	void assign(const char* a)
-	{
-		while (*a)
-		{
-			push_back(*a);
-			a++;
-		}
+		size_t siz = size();
+		int result = memcmp(data(), str, std::min(siz, len));
+		if (result)
+			return result;
+		return siz < len ? -1 : siz > len;
 	}
-	void assign(const char* a, size_t l)
+	int compare(const std::string& str) const
 	{
-		for (size_t i = 0; i < l; i++)
-			push_back(a[i]);
+		return compare(str.data(), str.size());
 	}
-	void assign(const std::string& str)
+	int compare(const basic_string& str) const
 	{
-		this->reserve(this->size() + str.size());
-		memcpy(this->data() + this->size(), str.c_str(), str.size());
-		this->_M_impl._M_finish = this->data() + this->size() + str.size();
+		return compare(str.data(), str.size());
 	}
-	void setdata(char* a, ssize_t slen, size_t buffsiz)
+	int compare(const char* str) const
 	{
-		delete this->data();
-		this->_M_impl._M_start = a;
-		this->_M_impl._M_finish = a + slen;
-		this->_M_impl._M_end_of_storage = a + buffsiz;
+		return compare(str, strlen(str));
 	}
 	std::string std_string() const
 	{
-		std::string a (this->begin(), this->end());
-		return a;
+		return std::string(data(), size());
 	}
 };
-std::istream& operator>> (std::istream& is, string& str)
+typedef basic_string<> string;
+
+template <typename A>
+bool operator ==(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return lh.size() == rh.size() && !memcmp(lh.data(), rh.data(), lh.size());
+}
+template <typename A>
+bool operator !=(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return !(lh == rh);
+}
+template <typename A>
+bool operator <(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return lh.compare(rh) < 0;
+}
+template <typename A>
+bool operator >(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return rh < lh;
+}
+template <typename A>
+bool operator <=(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return !(rh < lh);
+}
+template <typename A>
+bool operator >=(const basic_string<A>& lh, const basic_string<A>& rh)
+{
+	return !(lh < rh);
+}
+
+// Lines on the heap own their characters, count them when picking chunk sizes
+template <typename A>
+size_t stream_item_size(const basic_string<A>& str)
+{
+	return sizeof(str) + (str.capacity() > CSP_STRING_INLINE ? str.capacity() : 0);
+}
+template <typename A>
+std::istream& operator>> (std::istream& is, basic_string<A>& str)
 {
 	std::string a;
 	is >> a;
 	str.assign(a);
 	return is;
 }
-std::ostream& operator<< (std::ostream& os, const string& str)
+template <typename A>
+std::ostream& operator<< (std::ostream& os, const basic_string<A>& str)
 {
-	os << str.std_string();
+	os.write(str.data(), str.size());
 	return os;
 }
-string operator +(const string& lh, const string& rh)
+template <typename A>
+basic_string<A> operator +(const basic_string<A>& lh, const basic_string<A>& rh)
 {
-	string a = lh;
-	for (auto& b : rh)
-		a.push_back(b);
+	basic_string<A> a = lh;
+	a.append(rh);
 	return a;
 }
-string operator +(const string& lh, const std::string& rh)
+template <typename A>
+basic_string<A> operator +(const basic_string<A>& lh, const std::string& rh)
 {
-	string a = lh;
+	basic_string<A> a = lh;
 	a.append(rh);
 	return a;
 }
-string operator +(const string& lh, const char* rh)
+template <typename A>
+basic_string<A> operator +(const basic_string<A>& lh, const char* rh)
 {
-	string a = lh;
+	basic_string<A> a = lh;
 	a.append(rh);
 	return a;
 }
@@ -0,0 +1,224 @@
+/*
+ * uring.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef URING_H_
+#define URING_H_
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Define CSP_NO_URING to always take the synchronous path
+#if !defined(CSP_NO_URING) && defined(__linux__) && \
+		__has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define CSP_HAS_URING 1
+#endif
+
+namespace csp{
+
+// Reads and writes in flight at once for uring_cat and uring_write
+#ifndef CSP_URING_DEPTH
+#define CSP_URING_DEPTH 8
+#endif
+
+#ifdef CSP_HAS_URING
+
+// A small io_uring, set up with the raw syscalls so nothing else
+//   needs to be installed
+// Reads and writes go in the submission ring, finish in any order and
+//   come back through the completion ring with the tag they went in with
+// Only one thread may use it
+class uring
+{
+	int fd;
+	void* sq_map;
+	size_t sq_length;
+	void* cq_map;
+	size_t cq_length;
+	io_uring_sqe* sqes;
+	size_t sqes_length;
+
+	unsigned* sq_tail;
+	unsigned sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned cq_mask;
+	io_uring_cqe* cqes;
+
+	// Queued since the last io_uring_enter
+	unsigned unsubmitted;
+
+	uring() : fd(-1), sq_map(MAP_FAILED), cq_map(MAP_FAILED),
+		sqes((io_uring_sqe*)MAP_FAILED), unsubmitted(0) {}
+	uring(const uring&) = delete;
+	uring& operator =(const uring&) = delete;
+
+	// True if the kernel can do IORING_OP_READ and IORING_OP_WRITE
+	// Both came with the probe in 5.6, so a kernel without the probe
+	//   has io_uring but can't do either
+	bool supported()
+	{
+		size_t ops = 256;
+		std::vector<char> space (sizeof(io_uring_probe) +
+				ops * sizeof(io_uring_probe_op), 0);
+		io_uring_probe* probe = (io_uring_probe*)space.data();
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+				probe, ops) < 0)
+			return false;
+		for (int op : {IORING_OP_READ, IORING_OP_WRITE})
+			if (op > probe->last_op ||
+					!(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+				return false;
+		return true;
+	}
+
+	static void* map(int fd, size_t length, off_t offset)
+	{
+		return mmap(NULL, length, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, offset);
+	}
+
+	void queue(int op, int file, const char* buffer, unsigned length,
+			uint64_t offset, uint64_t tag)
+	{
+		unsigned tail = *sq_tail;
+		unsigned index = tail & sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = op;
+		sqe->fd = file;
+		sqe->addr = (uint64_t)buffer;
+		sqe->len = length;
+		sqe->off = offset;
+		sqe->user_data = tag;
+		sq_array[index] = index;
+		// The kernel mustn't see the new tail before the entry is filled in
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		unsubmitted++;
+	}
+public:
+	~uring()
+	{
+		if (sqes != MAP_FAILED)
+			munmap(sqes, sqes_length);
+		if (cq_map != MAP_FAILED)
+			munmap(cq_map, cq_length);
+		if (sq_map != MAP_FAILED)
+			munmap(sq_map, sq_length);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	// NULL if the kernel has no io_uring, won't give one out or can't
+	//   do plain reads and writes with it, callers go synchronous then
+	// Completions never overflow as long as no more than entries
+	//   are in flight
+	static std::unique_ptr<uring> open(unsigned entries)
+	{
+		std::unique_ptr<uring> ring (new uring());
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+		if (ring->fd < 0 || !ring->supported())
+			return NULL;
+
+		ring->sq_length = params.sq_off.array +
+				params.sq_entries * sizeof(unsigned);
+		ring->cq_length = params.cq_off.cqes +
+				params.cq_entries * sizeof(io_uring_cqe);
+		ring->sqes_length = params.sq_entries * sizeof(io_uring_sqe);
+		ring->sq_map = map(ring->fd, ring->sq_length, IORING_OFF_SQ_RING);
+		ring->cq_map = map(ring->fd, ring->cq_length, IORING_OFF_CQ_RING);
+		ring->sqes = (io_uring_sqe*)
+				map(ring->fd, ring->sqes_length, IORING_OFF_SQES);
+		if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED ||
+				ring->sqes == MAP_FAILED)
+			return NULL;
+
+		char* sq = (char*)ring->sq_map;
+		ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+		ring->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+		ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+		char* cq = (char*)ring->cq_map;
+		ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+		ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+		ring->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+		ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+		return ring;
+	}
+
+	// Queues a read of length bytes at offset in file into buffer
+	// Nothing starts until the next wait()
+	void read(int file, char* buffer, unsigned length, uint64_t offset,
+			uint64_t tag)
+	{
+		queue(IORING_OP_READ, file, buffer, length, offset, tag);
+	}
+	// Queues a write of length bytes from buffer at offset in file
+	void write(int file, const char* buffer, unsigned length,
+			uint64_t offset, uint64_t tag)
+	{
+		queue(IORING_OP_WRITE, file, buffer, length, offset, tag);
+	}
+
+	// Submits everything queued and blocks until something finishes
+	// result is what read(2) or write(2) would return, but -errno on error
+	// Returns false if io_uring_enter itself failed
+	bool wait(uint64_t& tag, int& result)
+	{
+		unsigned head = *cq_head;
+		while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) ||
+				unsubmitted)
+		{
+			int entered = syscall(__NR_io_uring_enter, fd, unsubmitted,
+					1, IORING_ENTER_GETEVENTS, NULL, 0);
+			if (entered < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			unsubmitted -= entered;
+		}
+		io_uring_cqe* cqe = &cqes[head & cq_mask];
+		tag = cqe->user_data;
+		result = cqe->res;
+		// Hands the entry back to the kernel
+		__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+};
+
+#else
+
+// Without io_uring headers there is never a ring, callers go synchronous
+class uring
+{
+public:
+	static std::unique_ptr<uring> open(unsigned)
+	{
+		return NULL;
+	}
+	void read(int, char*, unsigned, uint64_t, uint64_t) {}
+	void write(int, const char*, unsigned, uint64_t, uint64_t) {}
+	bool wait(uint64_t&, int&)
+	{
+		return false;
+	}
+};
+
+#endif
+
+}
+
+#endif /* URING_H_ */
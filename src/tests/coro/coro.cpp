@@ -0,0 +1,40 @@
+#include <csp/csplib.h>
+#include <csp/coro.h>
+
+using namespace csp;
+
+CSP_CORO_DECL(add, int, int, int)(int amount)
+{
+	int x;
+	while (co_await read(x))
+		co_await put(x + amount);
+	co_return;
+}
+
+CSP_CORO_DECL(total, int, nothing)()
+{
+	long sum = 0;
+	int x;
+	while (co_await read(x))
+		sum += x;
+	printf("%ld\n", sum);
+	// Every number went through 200 add(1)s, none lost on the way
+	if (sum != 4999950000L + 100000L * 200)
+		exit(1);
+	co_return;
+}
+
+int main()
+{
+	std::vector<int> nums;
+	for (int i = 0; i < 100000; i++)
+		nums.push_back(i);
+
+	// A long pipeline of coroutines that only needs a few threads
+	// Bounded streams make the coroutines wait on each other both ways
+	auto chain = vec(nums) | bounded(16, add(1));
+	for (int i = 0; i < 199; i++)
+		chain = std::move(chain) | bounded(16, add(1));
+	std::move(chain) | total();
+	return 0;
+}
@@ -0,0 +1,208 @@
+#include <csp/csplib.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+using namespace csp;
+
+int failures = 0;
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+std::string directory;
+
+std::string path(const char* name)
+{
+	return directory + "/" + name;
+}
+void write_file(const std::string& name, const std::string& content)
+{
+	std::ofstream out (name, std::ios::binary);
+	out << content;
+}
+
+std::string read_file(const std::string& name)
+{
+	std::ifstream in (name, std::ios::binary);
+	std::stringstream content;
+	content << in.rdbuf();
+	return content.str();
+}
+
+// Lines in content, a last line without a newline still counts
+std::vector<std::string> split(const std::string& content)
+{
+	std::vector<std::string> lines;
+	size_t start = 0;
+	while (start < content.size())
+	{
+		size_t end = content.find('\n', start);
+		if (end == std::string::npos)
+			end = content.size();
+		lines.push_back(content.substr(start, end - start));
+		start = end + 1;
+	}
+	return lines;
+}
+template <typename T>
+bool same(const std::vector<T>& got, const std::vector<std::string>& want)
+{
+	if (got.size() != want.size())
+		return false;
+	for (size_t i = 0; i < got.size(); i++)
+		if (std::string(got[i].data(), got[i].size()) != want[i])
+			return false;
+	return true;
+}
+
+// Lines that end right before, on and after block boundaries, empty
+//   lines, lines longer than a block and one with no newline at the end
+std::string make_content()
+{
+	std::string content;
+	uint32_t seed = 99;
+	auto next = [&]{ seed = seed * 1103515245 + 12345; return seed >> 8; };
+	for (int block = 1; block <= 3; block++)
+	{
+		size_t boundary = block * CSP_READ_BLOCK;
+		while (content.size() + 200 < boundary)
+			content += std::string(next() % 150, 'a' + next() % 26) + "\n";
+		for (int i = 0; content.size() < boundary - 1; i++)
+			content += "\n";
+		content += "x\n";
+		content += "\n";
+	}
+	content += std::string(CSP_READ_BLOCK * 2 + 17, 'L') + "\n";
+	content += std::string(CSP_READ_BLOCK, 'B') + "\n";
+	content += "short\n\n";
+	content += "no newline";
+	return content;
+}
+
+void readers(const std::string& content, const char* name)
+{
+	std::string file = path(name);
+	write_file(file, content);
+	std::vector<std::string> want = split(content);
+	std::string what;
+
+	int fd = open(file.c_str(), O_RDONLY);
+	line_reader reader (fd);
+	std::vector<std::string> got;
+	const char* line;
+	size_t length;
+	while (reader.next(line, length))
+		got.push_back(std::string(line, length));
+	close(fd);
+	what = std::string("line_reader ") + name;
+	check(what.c_str(), got == want && !reader.failed());
+
+	std::atomic<int> error (0);
+	auto plain = cat(file.c_str(), &error);
+	std::vector<string> lines;
+	plain >>= lines;
+	what = std::string("cat ") + name;
+	check(what.c_str(), same(lines, want) && error == 0);
+
+	// The views are good as long as the channel is
+	auto mapped = mmap_cat(file.c_str(), &error);
+	std::vector<line_view> views;
+	mapped >>= views;
+	what = std::string("mmap_cat ") + name;
+	check(what.c_str(), same(views, want) && error == 0);
+
+	auto ring = uring_cat(file.c_str(), &error);
+	std::vector<string> ring_lines;
+	ring >>= ring_lines;
+	what = std::string("uring_cat ") + name;
+	check(what.c_str(), same(ring_lines, want) && error == 0);
+}
+
+int main()
+{
+	char name[] = "/tmp/csp_files_XXXXXX";
+	if (!mkdtemp(name))
+		return 1;
+	directory = name;
+
+	std::string content = make_content();
+	readers(content, "blocks");
+	readers(content + "\n", "newline");
+	readers("", "empty");
+	readers("\n", "blank");
+	readers(std::string(CSP_READ_BLOCK - 1, 'e') + "\n", "one block");
+
+	// uring_cat reads a pipe the way cat does
+	std::string fifo = path("fifo");
+	mkfifo(fifo.c_str(), 0600);
+	std::thread feeder ([&]{ write_file(fifo, content); });
+	std::atomic<int> error (0);
+	auto piped = uring_cat(fifo.c_str(), &error);
+	std::vector<string> lines;
+	piped >>= lines;
+	feeder.join();
+	check("uring_cat pipe", same(lines, split(content)) && error == 0);
+
+	// uring_write writes the same bytes print does
+	std::vector<string> out;
+	for (auto& a : split(content))
+		out.push_back(string(a));
+	std::string written = path("written");
+	vec(out) | uring_write(written.c_str(), &error);
+	check("uring_write error", error == 0);
+
+	std::string printed = path("printed");
+	{
+		std::ofstream to (printed, std::ios::binary);
+		std::streambuf* old = std::cout.rdbuf(to.rdbuf());
+		vec(out) | print();
+		std::cout.rdbuf(old);
+	}
+	check("uring_write against print", read_file(written) == read_file(printed));
+	check("uring_write content", read_file(written) == content + "\n");
+
+	// And round trips through uring_cat
+	auto again = uring_cat(written.c_str(), &error);
+	std::vector<string> back;
+	again >>= back;
+	check("uring round trip", back == out && error == 0);
+
+	vec(out) | uring_write("/dev/null", &error);
+	check("uring_write not a file", error == 0);
+
+	std::atomic<int> unopened (0);
+	auto not_read = uring_cat(path("missing").c_str(), &unopened);
+	std::vector<string> no_lines;
+	not_read >>= no_lines;
+	check("uring_cat missing file", no_lines.empty() && unopened == 1);
+	std::atomic<int> unwritable (0);
+	vec(out) | uring_write(path("no/such/dir").c_str(), &unwritable);
+	check("uring_write bad path", unwritable == 1);
+
+	std::atomic<int> missing (0);
+	auto nothing_there = mmap_cat(path("missing").c_str(), &missing);
+	std::vector<line_view> none;
+	nothing_there >>= none;
+	check("mmap_cat missing file", none.empty() && missing == 1);
+
+	// Empty views hash the same whether or not they point anywhere
+	check("empty view hash", item_hash(line_view()) == item_hash(line_view("x", 0)) &&
+			item_hash(line_view()) == item_hash(string()));
+
+	for (const char* a : {"blocks", "newline", "empty", "blank", "one block",
+			"fifo", "written", "printed"})
+		unlink(path(a).c_str());
+	rmdir(name);
+
+	if (!failures)
+		printf("files ok\n");
+	return failures != 0;
+}
@@ -0,0 +1,100 @@
+#include <csp/csplib.h>
+
+using namespace csp;
+
+int failures = 0;
+
+// Runs lines through chan and checks exactly what comes out
+template <typename C>
+void expect(const char* what, std::vector<string> lines, C&& chan,
+		std::vector<string> want)
+{
+	auto piped = vec(lines) | std::move(chan);
+	std::vector<string> got;
+	piped >>= got;
+	if (got != want)
+	{
+		printf("FAILED: %s, got", what);
+		for (auto& a : got)
+			printf(" '%s'", std::string(a.data(), a.size()).c_str());
+		printf("\n");
+		failures++;
+	}
+}
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+void regex_filters()
+{
+	std::vector<string> words {"cat", "coat", "cot", "dog", "Cat", "cart!", ""};
+
+	expect("anchored", words, grep_re("^c[a-z]+t$"),
+			{"cat", "coat", "cot"});
+	expect("inverted", words, grep_re("^c[a-z]+t$", true),
+			{"dog", "Cat", "cart!", ""});
+	expect("alternation", {"dog", "cag", "a12", "1a2", "cog"},
+			grep_re("(do|ca)g|[[:digit:]]{2}"), {"dog", "cag", "a12"});
+	expect("repeat counts", {"a", "aa", "aaa", "baab"},
+			grep_re("^a{2,3}$"), {"aa", "aaa"});
+	expect("bracket ], and -", {"a]", "b-", "c", "-"},
+			grep_re("[]-]"), {"a]", "b-", "-"});
+	expect("empty line", words, grep_re("^$"), {""});
+	expect("dot", {"ab", "a", "axb"}, grep_re("a.b"), {"axb"});
+
+	// Malformed patterns set error and let nothing through
+	for (const char* bad : {"a(b", "a)b", "[abc", "[[:]", "[[:foo:]]",
+			"a{3,2}", "*a", "\\", "(", "[z-a]"})
+	{
+		std::atomic<int> error (0);
+		std::string what = std::string("malformed ") + bad;
+		expect(what.c_str(), words, grep_re(bad, false, &error), {});
+		check(what.c_str(), error == 1);
+	}
+	std::atomic<int> error (0);
+	expect("good pattern", words, grep_re("o", false, &error), {"coat", "cot", "dog"});
+	check("good pattern error", error == 0);
+}
+
+void multi_patterns()
+{
+	std::vector<string> lines {"the cat sat", "a dog ran", "cat and dog",
+			"neither", "dogcat"};
+	expect("grab_any", lines, grab_any({"cat", "dog"}),
+			{"the cat sat", "a dog ran", "cat and dog", "dogcat"});
+	expect("grab_any inverted", lines, grab_any({"cat", "dog"}, true),
+			{"neither"});
+	expect("grab_all", lines, grab_all({"cat", "dog"}),
+			{"cat and dog", "dogcat"});
+	expect("grab_all inverted", lines, grab_all({"cat", "dog"}, true),
+			{"the cat sat", "a dog ran", "neither"});
+	expect("grab_any overlapping", {"she", "hers", "his", "sh"},
+			grab_any({"he", "she", "hers"}), {"she", "hers"});
+
+	// Every byte value in the patterns at once
+	std::string all_bytes;
+	for (int i = 0; i < 256; i++)
+		all_bytes.push_back((char)i);
+	string has_all (all_bytes.data(), all_bytes.size());
+	string high ("\xfe\xff");
+	expect("grab_any every byte", {has_all, high, "plain"},
+			grab_any({all_bytes, "\xfe\xff"}), {has_all, high});
+	expect("grab_all every byte", {has_all, high, "plain"},
+			grab_all({all_bytes, "\xfe\xff"}), {has_all});
+}
+
+int main()
+{
+	regex_filters();
+	multi_patterns();
+
+	if (!failures)
+		printf("grep ok\n");
+	return failures != 0;
+}
@@ -0,0 +1,296 @@
+#include <csp/csplib.h>
+#include <csp/parallel.h>
+#include <csp/read.h>
+#include <chrono>
+#include <stdexcept>
+
+using namespace csp;
+
+int failures = 0;
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+CSP_DECL(add_one, long, long)()
+{
+	long x;
+	while (read(x))
+		put(x + 1);
+}
+
+// Mixes single reads and batches, so a batch can start with what read() took
+CSP_DECL(mixed_reads, long, long)()
+{
+	long batch[7];
+	long x;
+	while (read(x))
+	{
+		put(x);
+		size_t count = read_batch(batch, 7);
+		for (size_t i = 0; i < count; i++)
+			put(batch[i]);
+	}
+}
+
+// How many of slow_copy are running right now, and the most at once
+std::atomic<int> running (0);
+std::atomic<int> most_running (0);
+
+CSP_DECL(slow_copy, nothing, long, long)(long x)
+{
+	int now = ++running;
+	int most = most_running;
+	while (now > most && !most_running.compare_exchange_weak(most, now));
+	usleep(2000);
+	running--;
+	put(x);
+}
+
+long sum(std::vector<long>& numbers)
+{
+	long total = 0;
+	for (long a : numbers)
+		total += a;
+	return total;
+}
+
+void executors()
+{
+	// A task that throws hands the exception to whoever gets the future
+	auto failed = executor::get().run([]{ throw std::runtime_error("expected"); });
+	bool threw = false;
+	try
+	{
+		failed.get();
+	}
+	catch (std::runtime_error&)
+	{
+		threw = true;
+	}
+	check("task exception", threw);
+
+	// Far more blocking stages than cores, all waiting on each other
+	std::vector<long> numbers;
+	for (long i = 0; i < 10000; i++)
+		numbers.push_back(i);
+	auto chain = vec(numbers) | bounded(16, add_one());
+	for (int i = 0; i < 298; i++)
+		chain = std::move(chain) | bounded(16, add_one());
+	// The last one isn't read until it's done, so it can't be bounded
+	chain = std::move(chain) | add_one();
+	std::vector<long> out;
+	chain >>= out;
+	check("long chain", out.size() == numbers.size() &&
+			sum(out) == sum(numbers) + 300 * 10000L);
+
+	// Workers woken by a slow source get going right away
+	numbers.resize(2000);
+	auto start = std::chrono::steady_clock::now();
+	auto slow = chan_iter<long, long>([](long x)
+	{
+		if (x % 10 == 0)
+			usleep(1000);
+		return x;
+	});
+	auto work = chan_iter<long, long>([](long x){ return x * 2; });
+	auto paced = vec(numbers) | unbuffer(std::move(slow)) |
+			parallel(4, std::move(work));
+	std::vector<long> doubled;
+	paced >>= doubled;
+	double took = seconds_since(start);
+	check("parallel behind a slow source", doubled.size() == 2000 &&
+			sum(doubled) == 1999 * 2000);
+	// The source alone takes about 0.2s, a 10ms stall on each wake took 2s
+	if (took > 1.0)
+	{
+		printf("parallel behind a slow source took %.2fs\n", took);
+		check("parallel behind a slow source time", false);
+	}
+}
+
+void shared_input()
+{
+	// Workers sharing one input see every item exactly once
+	std::vector<long> numbers;
+	for (long i = 0; i < 100000; i++)
+		numbers.push_back(i);
+	auto mixed = mixed_reads();
+	auto shared = vec(numbers) | parallel(4, std::move(mixed));
+	std::vector<long> out;
+	shared >>= out;
+	std::sort(out.begin(), out.end());
+	check("shared input exactly once", out == numbers);
+
+	// The others get through the rest while one worker is stuck on an item,
+	//   only the few it took along with it wait
+	numbers.resize(400);
+	std::atomic<long> finished (0);
+	long finished_first = 0;
+	auto uneven = chan_iter<long, long>([&](long x)
+	{
+		usleep(x == 0 ? 500000 : 1000);
+		if (x == 0)
+			finished_first = finished;
+		finished++;
+		return x;
+	});
+	auto stuck = vec(numbers) | parallel(4, std::move(uneven));
+	out.clear();
+	stuck >>= out;
+	check("slow item", out.size() == 400 &&
+			finished_first >= 400 - CSP_CLAIM_ITEMS);
+}
+
+void ordered()
+{
+	// Output comes out in input order however long each item takes
+	std::vector<long> numbers;
+	for (long i = 0; i < 100000; i++)
+		numbers.push_back(i);
+	auto uneven = chan_iter<long, long>([](long x)
+	{
+		if (x % 5000 == 0)
+			usleep(2000);
+		return x * 2;
+	});
+	auto in_order = vec(numbers) | ordered_parallel(4, std::move(uneven));
+	std::vector<long> out;
+	in_order >>= out;
+	bool same = out.size() == numbers.size();
+	for (size_t i = 0; same && i < out.size(); i++)
+		same = out[i] == numbers[i] * 2;
+	check("ordered_parallel order", same);
+
+	// Channels that drop items too
+	auto evens = chan_select<long>([](long x){ return x % 2 == 0; });
+	auto filtered = vec(numbers) | ordered_parallel(3, std::move(evens));
+	out.clear();
+	filtered >>= out;
+	same = out.size() == numbers.size() / 2;
+	for (size_t i = 0; same && i < out.size(); i++)
+		same = out[i] == (long)i * 2;
+	check("ordered_parallel filter order", same);
+}
+
+void scheduled()
+{
+	// No more than max channels run at once, and every one of them runs
+	std::vector<long> numbers;
+	for (long i = 0; i < 200; i++)
+		numbers.push_back(i);
+	auto limited = vec(numbers) | schedule(slow_copy, 3);
+	std::vector<long> out;
+	limited >>= out;
+	check("schedule limit", most_running <= 3 && most_running > 0);
+	check("schedule output", out.size() == numbers.size() &&
+			sum(out) == sum(numbers));
+}
+
+void fused()
+{
+	std::vector<long> numbers;
+	for (long i = 0; i < 10000; i++)
+		numbers.push_back(i);
+
+	// chan_each puts only what its step says to
+	auto halves = chan_each<long, long>([](long& in, long& out)
+	{
+		out = in / 2;
+		return in % 2 == 0;
+	});
+	auto halved = vec(numbers) | std::move(halves);
+	std::vector<long> out;
+	halved >>= out;
+	bool same = out.size() == numbers.size() / 2;
+	for (size_t i = 0; same && i < out.size(); i++)
+		same = out[i] == (long)i;
+	check("chan_each", same);
+
+	// Fused steps give what the same steps give as separate channels
+	auto steps = []
+	{
+		return std::make_tuple(
+				chan_iter<long, long>([](long x){ return x + 1; }),
+				chan_select<long>([](long x){ return x % 3 != 0; }),
+				chan_iter<long, long>([](long x){ return x * 10; }));
+	};
+	auto apart = steps();
+	auto separate = vec(numbers) | std::move(std::get<0>(apart)) |
+			std::move(std::get<1>(apart)) | std::move(std::get<2>(apart));
+	std::vector<long> want;
+	separate >>= want;
+	auto together = steps();
+	auto one = vec(numbers) | fuse(std::move(std::get<0>(together)),
+			std::move(std::get<1>(together)), std::move(std::get<2>(together)));
+	out.clear();
+	one >>= out;
+	check("fuse", out == want && out.size() == 6667);
+}
+
+void callables()
+{
+	std::vector<long> numbers;
+	for (long i = 0; i < 1000; i++)
+		numbers.push_back(i);
+
+	// Mutable lambdas keep their state from one item to the next
+	long seen = 0;
+	auto every_other = chan_select<long>([seen](long) mutable
+	{
+		return seen++ % 2 == 0;
+	});
+	auto selected = vec(numbers) | std::move(every_other);
+	std::vector<long> out;
+	selected >>= out;
+	bool same = out.size() == numbers.size() / 2;
+	for (size_t i = 0; same && i < out.size(); i++)
+		same = out[i] == (long)i * 2;
+	check("chan_select mutable", same);
+
+	long total = 0;
+	auto running_sum = chan_iter<long, long>([total](long x) mutable
+	{
+		return total += x;
+	});
+	auto summed = vec(numbers) | std::move(running_sum);
+	out.clear();
+	summed >>= out;
+	check("chan_iter mutable", out.size() == numbers.size() &&
+			out.back() == sum(numbers));
+
+	// A functor, not just a lambda
+	struct counter
+	{
+		std::atomic<long>* count;
+		void operator()(long&) { (*count)++; }
+	};
+	std::atomic<long> count (0);
+	vec(numbers) | chan_read<long>(counter{&count});
+	check("chan_read functor", count == 1000);
+}
+
+int main()
+{
+	executors();
+	shared_input();
+	ordered();
+	scheduled();
+	fused();
+	callables();
+
+	if (!failures)
+		printf("parallel ok\n");
+	return failures != 0;
+}
@@ -0,0 +1,141 @@
+#include <csp/csplib.h>
+#include <algorithm>
+#include <set>
+
+using namespace csp;
+
+int failures = 0;
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// Same lines every run
+std::vector<string> make_lines(size_t count)
+{
+	std::vector<string> lines;
+	uint32_t seed = 12345;
+	auto next = [&]{ seed = seed * 1103515245 + 12345; return seed >> 8; };
+	std::string shared (100, 'p');
+	for (size_t i = 0; i < count; i++)
+	{
+		std::string line;
+		switch (next() % 4)
+		{
+		// Long lines that only differ past the radix depth
+		case 0:
+			line = shared + std::to_string(next() % 1000);
+			break;
+		// Bytes above 0x7f sort after ASCII
+		case 1:
+			line.push_back((char)(0x80 + next() % 0x80));
+			line += std::to_string(next() % 100);
+			break;
+		case 2:
+			for (uint32_t n = next() % 70; n; n--)
+				line.push_back('a' + next() % 26);
+			break;
+		default:
+			line = std::to_string(next() % 5000);
+		}
+		lines.push_back(string(line));
+	}
+	lines.push_back("");
+	return lines;
+}
+
+std::vector<string> sorted(std::vector<string> lines, bool reverse)
+{
+	std::vector<std::string> plain;
+	for (auto& a : lines)
+		plain.push_back(std::string(a.data(), a.size()));
+	std::sort(plain.begin(), plain.end());
+	if (reverse)
+		std::reverse(plain.begin(), plain.end());
+	std::vector<string> result;
+	for (auto& a : plain)
+		result.push_back(string(a));
+	return result;
+}
+
+void in_memory(std::vector<string>& lines)
+{
+	for (bool reverse : {false, true})
+	{
+		std::atomic<int> error (0);
+		auto chan = vec(lines) | sort<string>(reverse, 0, &error);
+		std::vector<string> got;
+		chan >>= got;
+		check(reverse ? "reverse sort" : "sort", got == sorted(lines, reverse));
+		check("sort error", error == 0);
+	}
+
+	// Not strings
+	std::vector<int> numbers {5, -3, 9, 0, 5, -100, 42};
+	auto ints = vec(numbers) | sort<int>();
+	std::vector<int> got_ints;
+	ints >>= got_ints;
+	check("int sort", got_ints == std::vector<int>({-100, -3, 0, 5, 5, 9, 42}));
+}
+
+// With enough files that they get merged along the way
+void spilled(std::vector<string>& lines)
+{
+	for (bool reverse : {false, true})
+	{
+		std::atomic<int> error (0);
+		auto chan = vec(lines) | sort<string>(reverse, 16 << 10, &error);
+		std::vector<string> got;
+		chan >>= got;
+		check(reverse ? "reverse spilled sort" : "spilled sort",
+				got == sorted(lines, reverse));
+		check("spilled sort error", error == 0);
+	}
+}
+
+void distincts(std::vector<string>& lines)
+{
+	// Keeps the first of each, in order
+	std::vector<string> repeats {"b", "a", "b", "c", "a", "", "", "d"};
+	auto unique = vec(repeats) | distinct<string>();
+	std::vector<string> got;
+	unique >>= got;
+	check("distinct", got == std::vector<string>({"b", "a", "c", "", "d"}));
+
+	// Past the budget it may drop a few, but never lets a repeat through
+	auto capped = vec(lines) | distinct<string>(64 << 10);
+	std::vector<string> kept;
+	capped >>= kept;
+	std::set<std::string> seen;
+	bool repeated = false;
+	for (auto& a : kept)
+		repeated |= !seen.insert(std::string(a.data(), a.size())).second;
+	std::set<std::string> all;
+	for (auto& a : lines)
+		all.insert(std::string(a.data(), a.size()));
+	check("distinct with budget repeats", !repeated);
+	check("distinct with budget kept", kept.size() <= all.size() &&
+			kept.size() > all.size() / 2);
+	auto exact = vec(lines) | distinct<string>();
+	std::vector<string> every;
+	exact >>= every;
+	check("distinct count", every.size() == all.size());
+}
+
+int main()
+{
+	std::vector<string> lines = make_lines(60000);
+
+	in_memory(lines);
+	spilled(lines);
+	distincts(lines);
+
+	if (!failures)
+		printf("sort ok\n");
+	return failures != 0;
+}
@@ -0,0 +1,311 @@
+#include <csp/csplib.h>
+#include <thread>
+
+using namespace csp;
+
+int failures = 0;
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// Only used here, so nothing else takes these rings from the pool
+struct pooled
+{
+	long a;
+};
+
+// Records that it was woken, instead of a sleeping thread
+struct waker : event_waiter
+{
+	std::atomic<bool> woke {false};
+	void wake() override
+	{
+		woke = true;
+	}
+};
+
+// Doubles its input a batch at a time
+CSP_DECL(double_batches, long, long)()
+{
+	std::vector<long> items (batch_size());
+	size_t count;
+	while ((count = read_batch(items.data(), items.size())))
+	{
+		for (size_t i = 0; i < count; i++)
+			items[i] *= 2;
+		put_batch(items.data(), count);
+	}
+}
+
+void rings()
+{
+	// Enough items that the writer outgrows the first ring many times
+	//   while the reader is draining it
+	const long count = 1000000;
+	message_stream<long> stream;
+	std::thread writer ([&]
+	{
+		for (long i = 0; i < count; i++)
+			stream.write(i);
+		stream.done();
+	});
+	long next = 0;
+	long x;
+	bool ordered = true;
+	while (stream.read(x))
+		ordered &= x == next++;
+	writer.join();
+	check("ring order", ordered && next == count);
+	check("ring read after done", !stream.read(x) && !stream.try_read(x));
+
+	// Items written before done() are still read after it
+	message_stream<std::string> strings;
+	strings.write("a");
+	strings.write(std::string(100, 'b'));
+	strings.done();
+	std::string s;
+	check("ring strings", strings.read(s) && s == "a" &&
+			strings.read(s) && s == std::string(100, 'b') && !strings.read(s));
+}
+
+void lanes()
+{
+	// Each writer gets a lane, the reader sees every lane's items in order
+	const int writers = 4;
+	const long count = 200000;
+	message_stream<long> stream;
+	std::vector<std::thread> threads;
+	for (int w = 0; w < writers; w++)
+		threads.emplace_back([&, w]
+		{
+			message_stream<long>* lane = stream.add_lane();
+			for (long i = 0; i < count; i++)
+				lane->write(i * writers + w);
+			lane->done();
+		});
+	// The stream itself is done once every lane is
+	std::thread closer ([&]
+	{
+		for (auto& a : threads)
+			a.join();
+		stream.done();
+	});
+	std::vector<long> next (writers, 0);
+	long x;
+	long total = 0;
+	bool ordered = true;
+	while (stream.read(x))
+	{
+		ordered &= x / writers == next[x % writers]++;
+		total++;
+	}
+	closer.join();
+	check("lanes keep each writer's order", ordered);
+	check("lanes lose nothing", total == writers * count);
+
+	// A finished lane is handed to the next writer
+	message_stream<long> reused;
+	message_stream<long>* first = reused.add_lane();
+	first->write(1);
+	first->done();
+	message_stream<long>* second = reused.add_lane();
+	second->write(2);
+	second->done();
+	reused.done();
+	long a = 0, b = 0;
+	check("lane reuse", first == second && reused.read(a) && reused.read(b) &&
+			a + b == 3 && !reused.read(x));
+}
+
+void capacity()
+{
+	// A full stream turns writes away until the reader takes something
+	message_stream<long> small (4);
+	bool took = true;
+	for (long i = 0; i < 4; i++)
+		took &= small.try_write(std::move(i));
+	long extra = 4;
+	check("try_write until full", took && !small.has_space() &&
+			!small.try_write(std::move(extra)));
+	long x;
+	check("try_write after a read", small.read(x) && x == 0 &&
+			small.try_write(std::move(extra)));
+
+	// The writer never gets more than capacity items ahead
+	const size_t limit = 8;
+	message_stream<long> stream (limit);
+	std::atomic<long> written (0);
+	std::thread writer ([&]
+	{
+		for (long i = 0; i < 20000; i++)
+		{
+			stream.write(i);
+			written++;
+		}
+		stream.done();
+	});
+	long read = 0;
+	bool bounded = true;
+	while (stream.read(x))
+	{
+		read++;
+		bounded &= written <= read + (long)limit;
+		if (read % 1000 == 0)
+			usleep(1000);
+	}
+	writer.join();
+	check("capacity bounds the writer", bounded && read == 20000);
+}
+
+void batches()
+{
+	// A batch read takes what's there up to max, no more
+	message_stream<long> stream;
+	long items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	stream.write_batch(items, 10);
+	stream.done();
+	long got[16];
+	size_t first = stream.read_batch(got, 4);
+	size_t rest = stream.read_batch(got + first, 16);
+	bool same = first == 4 && rest == 6;
+	for (long i = 0; same && i < 10; i++)
+		same = got[i] == i;
+	check("read_batch", same && stream.read_batch(got, 16) == 0);
+
+	// And through channels
+	std::vector<long> numbers;
+	for (long i = 0; i < 100000; i++)
+		numbers.push_back(i);
+	auto doubled = vec(numbers) | double_batches();
+	std::vector<long> out;
+	doubled >>= out;
+	bool ordered = out.size() == numbers.size();
+	for (size_t i = 0; ordered && i < out.size(); i++)
+		ordered = out[i] == numbers[i] * 2;
+	check("read_batch and put_batch in a channel", ordered);
+}
+
+void chunks()
+{
+	// Small items get big chunks, big items small ones, all within bounds
+	message_stream<long> numbers;
+	numbers.adaptive = true;
+	for (long i = 0; i < 100000; i++)
+		numbers.write(i);
+	numbers.done();
+	size_t small_items = numbers.chunk;
+	check("adaptive chunk for small items",
+			small_items >= CSP_CHUNK_BYTES / sizeof(long) &&
+			small_items <= CSP_CHUNK_MAX);
+
+	message_stream<string> lines;
+	lines.adaptive = true;
+	string line (std::string(2000, 'x'));
+	for (int i = 0; i < 10000; i++)
+		lines.write(line);
+	lines.done();
+	check("adaptive chunk for big items", lines.chunk == CSP_CHUNK_MIN);
+
+	// Nothing is lost to the chunks changing under the writer
+	long x;
+	long next = 0;
+	while (numbers.read(x) && x == next)
+		next++;
+	string s;
+	int count = 0;
+	while (lines.read(s) && s == line)
+		count++;
+	check("adaptive chunk items", next == 100000 && count == 10000);
+
+	// A fixed chunk is at least one item
+	auto single = chunked(0, chan_iter<long, long>([](long a){ return a; }));
+	auto many = chunked(1000, chan_iter<long, long>([](long a){ return a; }));
+	check("chunked", single->csp_output->chunk == 1 &&
+			many->csp_output->chunk == 1000);
+}
+
+void pool()
+{
+	ring_pool<pooled>& rings = ring_pool<pooled>::get();
+	stream_ring<pooled>* ring = rings.take(100);
+	check("pool rounds up", ring->mask + 1 == 128);
+	rings.give(ring);
+	check("pool reuses", rings.take(128) == ring);
+
+	// A stream takes its first ring from the pool and gives it back
+	stream_ring<pooled>* first = rings.take(CSP_CACHE_DEFAULT * 2);
+	rings.give(first);
+	message_stream<pooled>* stream = new message_stream<pooled>();
+	stream_ring<pooled>* other = rings.take(CSP_CACHE_DEFAULT * 2);
+	check("stream takes from the pool", other != first);
+	rings.give(other);
+	rings.give(ring);
+
+	// Growing past the first ring and being deleted returns all of them
+	for (long i = 0; i < 10000; i++)
+		stream->write(pooled{i});
+	stream->done();
+	pooled p;
+	long sum = 0;
+	while (stream->read(p))
+		sum += p.a;
+	delete stream;
+	check("pooled stream items", sum == 9999 * 10000 / 2);
+	check("stream gives back", rings.take(CSP_CACHE_DEFAULT * 2) == first);
+}
+
+void events()
+{
+	// Threads asleep on an event all wake once it's notified
+	event ready;
+	std::atomic<bool> flag (false);
+	std::atomic<int> awake (0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 3; i++)
+		threads.emplace_back([&]
+		{
+			ready.wait([&]{ return flag.load(); });
+			awake++;
+		});
+	usleep(50000);
+	check("event sleepers", ready.waiting() && awake == 0);
+	flag = true;
+	ready.notify_all();
+	for (auto& a : threads)
+		a.join();
+	check("event wakes all", awake == 3 && !ready.waiting());
+
+	// A waiter that doesn't need to wait isn't woken
+	event later;
+	waker first;
+	check("wait_async ready", !later.wait_async(&first, []{ return true; }));
+	later.notify_all();
+	check("wait_async ready not woken", !first.woke);
+	// One that does is woken once
+	waker second;
+	check("wait_async waits", later.wait_async(&second, []{ return false; }) &&
+			!second.woke);
+	later.notify_all();
+	check("wait_async woken", second.woke);
+}
+
+int main()
+{
+	rings();
+	lanes();
+	capacity();
+	batches();
+	chunks();
+	pool();
+	events();
+
+	if (!failures)
+		printf("stream ok\n");
+	return failures != 0;
+}
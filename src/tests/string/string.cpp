@@ -0,0 +1,230 @@
+#include <csp/csplib.h>
+#include <stdexcept>
+
+using namespace csp;
+
+int failures = 0;
+
+void check(const char* what, bool ok)
+{
+	if (!ok)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// Buffers a string has allocated and not freed yet
+int live = 0;
+template <typename T>
+struct counting
+{
+	typedef T value_type;
+	counting() {}
+	template <typename U>
+	counting(const counting<U>&) {}
+	T* allocate(size_t n)
+	{
+		live++;
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T* p, size_t n)
+	{
+		live--;
+		std::allocator<T>().deallocate(p, n);
+	}
+	bool operator ==(const counting&) const { return true; }
+	bool operator !=(const counting&) const { return false; }
+};
+typedef basic_string<counting<char>> counted;
+
+bool same(const counted& a, const std::string& b)
+{
+	return a.size() == b.size() && !memcmp(a.data(), b.data(), b.size());
+}
+
+// Plain searches to check the fast ones against
+const char* naive_find(const std::string& a, const std::string& b, bool nocase)
+{
+	for (size_t i = 0; i + b.size() <= a.size(); i++)
+	{
+		size_t j = 0;
+		while (j < b.size() && (nocase ? (char)tolower((unsigned char)a[i + j]) :
+				a[i + j]) == b[j])
+			j++;
+		if (j == b.size())
+			return a.data() + i;
+	}
+	return NULL;
+}
+
+void searches()
+{
+	std::string text = "The quick brown fox jumps over the lazy dog";
+	check("find_bytes middle",
+			find_bytes(text.data(), text.size(), "fox", 3) == text.data() + 16);
+	check("find_bytes end",
+			find_bytes(text.data(), text.size(), "dog", 3) == text.data() + 40);
+	check("find_bytes missing",
+			find_bytes(text.data(), text.size(), "cat", 3) == NULL);
+	check("find_bytes empty",
+			find_bytes(text.data(), text.size(), "", 0) == text.data());
+	check("find_bytes too long",
+			find_bytes("ab", 2, "abc", 3) == NULL);
+	string line (text);
+	check("string find", line.find("lazy") == 35 && line.find("cat") == string::npos);
+	check("find_nocase",
+			find_nocase(text.data(), text.size(), "the lazy", 8) == text.data() + 31);
+	check("find_nocase first",
+			find_nocase(text.data(), text.size(), "the", 3) == text.data());
+	check("find_nocase missing",
+			find_nocase(text.data(), text.size(), "cat", 3) == NULL);
+
+	// Lengths around the vector widths, near misses and high bytes
+	uint32_t seed = 777;
+	auto next = [&]{ seed = seed * 1103515245 + 12345; return seed >> 8; };
+	const char letters[] = "aAbB\xe9\xc9";
+	for (int round = 0; round < 20000; round++)
+	{
+		std::string a, b;
+		for (uint32_t n = next() % 80; n; n--)
+			a.push_back(letters[next() % (round % 3 ? 2 : 6)]);
+		for (uint32_t n = 1 + next() % 6; n; n--)
+			b.push_back(letters[next() % (round % 3 ? 2 : 6)]);
+		if (next() % 2 && !a.empty())
+			b = a.substr(next() % a.size(), b.size());
+		if (b.empty())
+			continue;
+		if (find_bytes(a.data(), a.size(), b.data(), b.size()) !=
+				naive_find(a, b, false))
+		{
+			check("find_bytes against naive", false);
+			return;
+		}
+		std::string lower = b;
+		for (auto& c : lower)
+			c = tolower((unsigned char)c);
+		if (find_nocase(a.data(), a.size(), lower.data(), lower.size()) !=
+				naive_find(a, lower, true))
+		{
+			check("find_nocase against naive", false);
+			return;
+		}
+	}
+
+	// Nearly matches everywhere, the slow case for checking candidates
+	std::string hay (100000, 'A');
+	std::string needle (500, 'a');
+	needle.back() = 'b';
+	check("find_nocase near matches",
+			find_nocase(hay.data(), hay.size(), needle.data(), needle.size()) == NULL);
+	hay += "AB";
+	check("find_nocase near matches found",
+			find_nocase(hay.data(), hay.size(), needle.data(), needle.size()) ==
+			hay.data() + hay.size() - needle.size());
+
+	// Patterns whose table fits on the stack and ones that don't
+	for (size_t size : {1, CSP_KMP_STACK - 1, CSP_KMP_STACK, CSP_KMP_STACK + 1, 300})
+	{
+		std::string pattern (size, 'a');
+		pattern.back() = 'b';
+		std::string a = std::string(1000, 'A') + "aAb" + std::string(size, 'A') + "B";
+		std::string what = "find_nocase_linear " + std::to_string(size);
+		check(what.c_str(), find_nocase_linear(a.data(), a.size(),
+				pattern.data(), pattern.size()) == naive_find(a, pattern, true));
+	}
+}
+
+void lowering()
+{
+	auto lowered = [](std::string a)
+	{
+		lower_utf8(&a[0], a.size());
+		return a;
+	};
+	check("lower ascii", lowered("Hello, WORLD! 0123456789 [ABCXYZ]") ==
+			"hello, world! 0123456789 [abcxyz]");
+	check("lower latin-1", lowered("\xc3\x80\xc3\x89\xc3\x9e \xc3\x97") ==
+			"\xc3\xa0\xc3\xa9\xc3\xbe \xc3\x97");
+	check("lower extended-a", lowered("\xc4\x80\xc4\x82\xc5\xb8\xc4\xb0") ==
+			"\xc4\x81\xc4\x83\xc3\xbf\xc4\xb0");
+	check("lower greek", lowered("\xce\x91\xce\xa9") == "\xce\xb1\xcf\x89");
+	check("lower cyrillic", lowered("\xd0\x90\xd0\xaf\xd0\x80\xd0\x8f") ==
+			"\xd0\xb0\xd1\x8f\xd1\x90\xd1\x9f");
+	check("lower leaves others", lowered("\xe2\x82\xac \xff Q \xc3") ==
+			"\xe2\x82\xac \xff q \xc3");
+}
+
+void strings()
+{
+	{
+		std::string fits (CSP_STRING_INLINE, 'x');
+		counted a (fits.data(), fits.size());
+		check("inline", same(a, fits) && live == 0);
+		a.push_back('y');
+		check("inline to heap", same(a, fits + "y") && live == 1 &&
+				a.capacity() > CSP_STRING_INLINE);
+
+		counted b ("short");
+		b.append(b.data(), b.size());
+		check("append itself inline", same(b, "shortshort") && live == 1);
+		std::string longer (40, 'z');
+		counted c (longer.data(), longer.size());
+		c.append(c.data(), c.size());
+		check("append itself to heap", same(c, longer + longer) && live == 2);
+
+		counted moved (std::move(a));
+		check("move heap", same(moved, fits + "y") && a.empty() && live == 2);
+		counted small ("tiny");
+		counted moved_small (std::move(small));
+		check("move inline", same(moved_small, "tiny") && small.empty() && live == 2);
+
+		counted copy (moved);
+		check("copy heap", same(copy, fits + "y") && live == 3);
+		copy.assign("now short");
+		check("short into heap", same(copy, "now short") && live == 3);
+		copy = moved_small;
+		check("copy inline into heap", same(copy, "tiny") && live == 3);
+
+		moved.swap(moved_small);
+		check("swap", same(moved, "tiny") && same(moved_small, fits + "y") &&
+				live == 3);
+		moved = std::move(moved_small);
+		check("move heap over inline", same(moved, fits + "y") && live == 3);
+
+		counted sized;
+		sized.resize(100, '-');
+		check("resize up", same(sized, std::string(100, '-')) && live == 4);
+		sized.resize(3);
+		check("resize down", same(sized, "---"));
+		sized.clear();
+		sized += "again";
+		check("clear and reuse", same(sized, "again"));
+
+		bool threw = false;
+		try
+		{
+			sized.at(5);
+		}
+		catch (std::out_of_range&)
+		{
+			threw = true;
+		}
+		check("at past the end", threw);
+	}
+	check("every buffer freed", live == 0);
+
+	check("unsigned order", string("\xff") > string("z") &&
+			string("ab") < string("abc") && string("") < string("a"));
+}
+
+int main()
+{
+	searches();
+	lowering();
+	strings();
+
+	if (!failures)
+		printf("string ok\n");
+	return failures != 0;
+}
@@ -75,7 +75,7 @@ int main(int argc, const char* argv[])
 	const char* file = argc > 1? argv[1] : "/usr/share/dict/words";
 
 	std::atomic<int> error (0);
-	cat(file, &error) | grab("'", true) | to_lower() | sort<string>() |
+	cat(file, &error) | fuse(grab("'", true), to_lower()) | sort<string>() |
 			uniq<string>() | elementize() >>= dict;
 
 	if (error)